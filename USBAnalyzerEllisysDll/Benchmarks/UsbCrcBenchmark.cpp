@@ -0,0 +1,120 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbCrcBenchmark.cpp
+/// @brief
+///		Compares the CRC-16 slicing-by-8 kernel with the library routine.
+/// @remarks
+///		This program is built by the UsbCrcBenchmark project of the
+///		solution, a console application linked with the USB Analysis SDK
+///		library, and is run in its Release configuration. It computes the
+///		CRC-16 of the same payloads with the inline kernel of the iterator
+///		overload of UsbCRC::ComputeUsbCRC16 and with the overload taking a
+///		pointer and a size, compiled in the library. It prints the
+///		throughput of each and stops if their results differ.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include "UsbAnalysis.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace
+{
+// The payload sizes of a short control transfer up to a high speed isochronous packet
+const size_t payloadSizes[] = { 8, 64, 512, 1024 };
+const size_t payloadCount = 256;
+const size_t bytesPerMeasure = 256 * 1024 * 1024;
+
+typedef std::vector<BYTE> vector_payload;
+
+usbdk::usb_crc16 ComputeWithKernel(const vector_payload& payload)
+{
+	return usbdk::UsbCRC::ComputeUsbCRC16(payload.begin(), payload.end());
+}
+
+usbdk::usb_crc16 ComputeWithLibrary(const vector_payload& payload)
+{
+	return usbdk::UsbCRC::ComputeUsbCRC16(&payload[0], payload.size());
+}
+
+// Computes the CRC-16 of the payloads in turn, the results are summed so the calls are not optimized away
+double MeasureMegabytesPerSecond(usbdk::usb_crc16 (*pCompute)(const vector_payload&), const std::vector<vector_payload>& payloads, DWORD* pSum)
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER start;
+	LARGE_INTEGER stop;
+
+	QueryPerformanceFrequency(&frequency);
+
+	const size_t passCount = bytesPerMeasure / (payloads.size() * payloads[0].size());
+	DWORD sum = 0;
+
+	QueryPerformanceCounter(&start);
+
+	for(size_t pass=0; pass<passCount; ++pass)
+	{
+		for(size_t i=0; i<payloads.size(); ++i)
+		{
+			sum += pCompute(payloads[i]);
+		}
+	}
+
+	QueryPerformanceCounter(&stop);
+
+	*pSum += sum;
+
+	const double seconds = (double) (stop.QuadPart - start.QuadPart) / frequency.QuadPart;
+	return (double) passCount * payloads.size() * payloads[0].size() / seconds / 1e6;
+}
+}
+
+int main()
+{
+	DWORD sum = 0;
+	DWORD seed = 1;
+
+	for(size_t sizeIndex=0; sizeIndex<countof(payloadSizes); ++sizeIndex)
+	{
+		// Pseudo-random payloads, the same on every run
+		std::vector<vector_payload> payloads(payloadCount, vector_payload(payloadSizes[sizeIndex]));
+
+		for(size_t i=0; i<payloads.size(); ++i)
+		{
+			for(size_t j=0; j<payloads[i].size(); ++j)
+			{
+				seed = seed * 1103515245 + 12345;
+				payloads[i][j] = (BYTE) (seed >> 16);
+			}
+
+			if(ComputeWithKernel(payloads[i]) != ComputeWithLibrary(payloads[i]))
+			{
+				printf("The CRC-16 differ on a payload of %u bytes\n", (unsigned) payloads[i].size());
+				return 1;
+			}
+		}
+
+		// The first runs warm up the caches and the branch predictors
+		MeasureMegabytesPerSecond(ComputeWithKernel, payloads, &sum);
+		MeasureMegabytesPerSecond(ComputeWithLibrary, payloads, &sum);
+
+		const double kernelThroughput = MeasureMegabytesPerSecond(ComputeWithKernel, payloads, &sum);
+		const double libraryThroughput = MeasureMegabytesPerSecond(ComputeWithLibrary, payloads, &sum);
+
+		printf("%4u bytes: slicing-by-8 %7.1f MB/s, library %7.1f MB/s\n",
+			(unsigned) payloadSizes[sizeIndex], kernelThroughput, libraryThroughput);
+	}
+
+	printf("Checksum: %08X\n", (unsigned) sum);
+
+	return 0;
+}
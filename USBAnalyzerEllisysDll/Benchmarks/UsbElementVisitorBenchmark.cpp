@@ -0,0 +1,149 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbElementVisitorBenchmark.cpp
+/// @brief
+///		Compares the dispatch of UsbElementVisitor and UsbElementProcessor.
+/// @remarks
+///		This program is built by the UsbElementVisitorBenchmark project of
+///		the solution, a console application linked with the USB Analysis
+///		SDK library, and is run in its Release configuration. It sends the
+///		same elements to a sink derived from each class and prints the time
+///		spent per element.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include "UsbAnalysis.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace
+{
+const size_t elementCount = 3000;
+const size_t passCount = 1000;
+
+class VisitorCounter : public usbdk::UsbElementVisitor<VisitorCounter>
+{
+	friend class usbdk::UsbElementVisitor<VisitorCounter>;
+
+public:
+	size_t m_transactionCount;
+	size_t m_startOfFrameCount;
+
+	VisitorCounter() : m_transactionCount(0), m_startOfFrameCount(0) {}
+
+	virtual void InitializeElementSink() {}
+	virtual void FinalizeElementSink() {}
+
+protected:
+	void ProcessStartOfFrame(usbdk::UsbStartOfFrame*) { ++m_startOfFrameCount; }
+	void ProcessTransaction(usbdk::UsbTransaction*) { ++m_transactionCount; }
+};
+
+class ProcessorCounter : public usbdk::UsbElementProcessor
+{
+public:
+	size_t m_transactionCount;
+	size_t m_startOfFrameCount;
+
+	ProcessorCounter() : m_transactionCount(0), m_startOfFrameCount(0) {}
+
+	virtual void InitializeElementSink() {}
+	virtual void FinalizeElementSink() {}
+
+protected:
+	virtual void ProcessInvalidPacket(usbdk::UsbInvalidPacket*) {}
+	virtual void ProcessStartOfFrame(usbdk::UsbStartOfFrame*) { ++m_startOfFrameCount; }
+	virtual void ProcessTransaction(usbdk::UsbTransaction*) { ++m_transactionCount; }
+	virtual void ProcessSplitTransaction(usbdk::UsbSplitTransaction*) {}
+	virtual void ProcessLpmTransaction(usbdk::UsbLpmTransaction*) {}
+	virtual void ProcessSuspended(usbdk::UsbSuspended*) {}
+	virtual void ProcessKeepAlive(usbdk::UsbKeepAlive*) {}
+	virtual void ProcessReset(usbdk::UsbReset*) {}
+	virtual void ProcessPowerChange(usbdk::UsbPowerChange*) {}
+	virtual void ProcessHighSpeedHandshake(usbdk::UsbHighSpeedHandshake*) {}
+	virtual void ProcessTrigger(usbdk::UsbTrigger*) {}
+	virtual void ProcessUnknownElement(usbdk::UsbElement*) {}
+};
+
+// Sends the elements to the sink through its interface, as an analyzer does
+double MeasureNanosecondsPerElement(usbdk::IUsbElementSink* pSink, const std::vector<usbdk::UsbElement*>& elements)
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER start;
+	LARGE_INTEGER stop;
+
+	QueryPerformanceFrequency(&frequency);
+
+	pSink->InitializeElementSink();
+	QueryPerformanceCounter(&start);
+
+	for(size_t pass=0; pass<passCount; ++pass)
+	{
+		for(size_t i=0; i<elements.size(); ++i)
+		{
+			pSink->OnElementArrival(elements[i]);
+		}
+	}
+
+	QueryPerformanceCounter(&stop);
+	pSink->FinalizeElementSink();
+
+	const double seconds = (double) (stop.QuadPart - start.QuadPart) / frequency.QuadPart;
+	return seconds * 1e9 / ((double) passCount * elements.size());
+}
+}
+
+int main()
+{
+	// Mixed traffic, the element types alternate like on a busy bus
+	std::vector<usbdk::UsbElement*> elements;
+	elements.reserve(elementCount);
+
+	for(size_t i=0; i<elementCount; i+=3)
+	{
+		elements.push_back(usbdk::CreateElementInstance<usbdk::UsbStartOfFrame>());
+		elements.push_back(usbdk::CreateElementInstance<usbdk::UsbTransaction>());
+		elements.push_back(usbdk::CreateElementInstance<usbdk::UsbReset>());
+	}
+
+	// The elements are created without reference
+	for(size_t i=0; i<elements.size(); ++i)
+	{
+		elements[i]->AddRef();
+	}
+
+	VisitorCounter visitor;
+	ProcessorCounter processor;
+
+	// The first runs warm up the caches and the branch predictors
+	MeasureNanosecondsPerElement(&visitor, elements);
+	MeasureNanosecondsPerElement(&processor, elements);
+
+	const double visitorTime = MeasureNanosecondsPerElement(&visitor, elements);
+	const double processorTime = MeasureNanosecondsPerElement(&processor, elements);
+
+	printf("UsbElementVisitor:   %.2f ns per element\n", visitorTime);
+	printf("UsbElementProcessor: %.2f ns per element\n", processorTime);
+
+	// The counters are used, so the handlers are not optimized away
+	printf("Elements counted: %u, %u\n",
+		(unsigned) (visitor.m_transactionCount + visitor.m_startOfFrameCount),
+		(unsigned) (processor.m_transactionCount + processor.m_startOfFrameCount));
+
+	for(size_t i=0; i<elements.size(); ++i)
+	{
+		elements[i]->Release();
+	}
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file ParallelUsbElementSinkManager.h
+/// @brief
+///		USB Analysis SDK parallel element sinks manager declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdexcept>
+
+namespace usbdk {
+
+/////////////////////////////////////////////////////////////////////////////
+// ParallelUsbElementSinkManager
+
+/// @brief
+/// 	Broadcasts the USB elements to several sinks running in parallel.
+/// @remarks
+/// 	Unlike ChainableUsbElementSinkManager, the sinks are not chained: each
+/// 	sink receives all the elements, on its own worker thread fed by its own
+/// 	UsbElementQueue. The elements are shared by the sinks with a reference
+/// 	each, they are never copied. The cost of the acquisition thread is one
+/// 	queue push per sink, whatever the cost of the sinks.
+///
+/// 	The sinks are initialized in their order of addition by
+/// 	InitializeElementSink, before the workers are started. FinalizeElementSink
+/// 	waits until every worker has sent all its queued elements, then finalizes
+/// 	the sinks in their order of addition, on the calling thread.
+///
+/// 	A sink throwing an exception from OnElementArrival receives no more
+/// 	elements. The error is thrown again on the acquisition thread by the next
+/// 	call to OnElementArrival, which then does not deliver its element, or by
+/// 	FinalizeElementSink. The error is thrown only once. When several sinks
+/// 	failed, the error of the first added sink is thrown. A std::exception
+/// 	is thrown again as a std::runtime_error with the same message, and a
+/// 	std::tstring as a std::tstring.
+///
+/// 	The elements must use the multi-threaded reference counting policy
+/// 	(the default). Each sink is called by one thread at a time, but
+/// 	different sinks are called concurrently.
+/// @seealso
+/// 	ChainableUsbElementSinkManager, UsbElementSinkAsync, UsbElementQueue
+/// @sample
+/// \code
+/// usbdk::ParallelUsbElementSinkManager sinkManager;
+/// sinkManager.AddElementSink(&myStatistics);
+/// sinkManager.AddElementSink(&myExporter);
+/// sinkManager.AddElementSink(&myTrigger);
+///
+/// pAnalyzer->BeginAcquisition(&sinkManager);
+/// ...
+/// size_t exporterLag = sinkManager.GetLag(&myExporter);
+/// \endcode
+class ParallelUsbElementSinkManager : public IUsbElementSink
+{
+private:
+	/// Error thrown by a sink.
+	enum sink_error
+	{
+		sinkErrorNone,
+		sinkErrorException,		///< std::exception
+		sinkErrorString,		///< std::tstring
+		sinkErrorUnknown,		///< Other type
+	};
+
+	struct sink_worker
+	{
+		ChainableUsbElementSink* pSink;
+		UsbElementQueue* pQueue;
+		HANDLE hThread;
+		size_t peakLag;
+		size_t droppedCount;
+		volatile LONG hasFailed;
+		volatile LONG* pHasAnyFailed;
+		sink_error error;
+		std::string exceptionMessage;
+		std::tstring stringMessage;
+	};
+
+	typedef std::vector<sink_worker*> vector_sink_worker;
+	vector_sink_worker m_workers;
+
+	size_t m_capacity;
+	usb_overflow_policy m_overflowPolicy;
+	volatile LONG m_hasFailed;
+	bool m_isErrorThrown;
+
+public:
+	/// @brief
+	/// 	Constructs a ParallelUsbElementSinkManager object.
+	/// @seealso
+	/// 	~ParallelUsbElementSinkManager()
+	inline ParallelUsbElementSinkManager();
+
+	/// @brief
+	/// 	Destroys a ParallelUsbElementSinkManager object.
+	/// @remarks
+	/// 	The workers are stopped if the manager was not finalized.
+	/// @seealso
+	/// 	ParallelUsbElementSinkManager()
+	inline virtual ~ParallelUsbElementSinkManager();
+
+public:
+	/// @brief
+	/// 	Adds an USB element sink.
+	/// @remarks
+	/// 	The sinks must be added before InitializeElementSink.
+	/// @param
+	/// 	pElementSink - The element sink to add.
+	/// @seealso
+	/// 	RemoveElementSink
+	inline void AddElementSink(ChainableUsbElementSink* pElementSink);
+
+	/// @brief
+	/// 	Removes an USB element sink.
+	/// @remarks
+	/// 	The sinks must be removed after FinalizeElementSink.
+	/// @param
+	/// 	pElementSink - The element sink to remove.
+	/// @seealso
+	/// 	AddElementSink
+	inline void RemoveElementSink(ChainableUsbElementSink* pElementSink);
+
+	/// @brief
+	/// 	Removes all USB element sinks.
+	/// @seealso
+	/// 	RemoveElementSink
+	inline void ClearElementSinks();
+
+public:
+	/// @brief
+	/// 	Sets the count of elements of the queue of each sink.
+	/// @remarks
+	/// 	The capacity is used by the next call to InitializeElementSink.
+	///		The default capacity is UsbElementSinkAsync::defaultCapacity.
+	inline void SetCapacity(size_t capacity);
+
+	/// @brief
+	/// 	Gets the count of elements of the queue of each sink.
+	inline size_t GetCapacity() const;
+
+	/// @brief
+	/// 	Sets what is done with a new element when the queue of a sink is full.
+	/// @remarks
+	/// 	The default policy is overflowBlock: the acquisition thread is then
+	///		slowed down to the speed of the slowest sink.
+	/// @seealso
+	/// 	usb_overflow_policy, GetDroppedCount
+	inline void SetOverflowPolicy(usb_overflow_policy policy);
+
+	/// @brief
+	/// 	Gets what is done with a new element when the queue of a sink is full.
+	inline usb_overflow_policy GetOverflowPolicy() const;
+
+public:
+	/// @brief
+	/// 	Gets the count of elements not yet processed by a sink.
+	/// @param
+	/// 	pElementSink - The element sink.
+	/// @seealso
+	/// 	GetPeakLag
+	inline size_t GetLag(const ChainableUsbElementSink* pElementSink) const;
+
+	/// @brief
+	/// 	Gets the highest count of elements not yet processed by a sink.
+	/// @remarks
+	/// 	The peak is reset by InitializeElementSink.
+	/// @param
+	/// 	pElementSink - The element sink.
+	/// @seealso
+	/// 	GetLag
+	inline size_t GetPeakLag(const ChainableUsbElementSink* pElementSink) const;
+
+	/// @brief
+	/// 	Gets the count of elements dropped for a sink.
+	/// @param
+	/// 	pElementSink - The element sink.
+	/// @seealso
+	/// 	SetOverflowPolicy
+	inline size_t GetDroppedCount(const ChainableUsbElementSink* pElementSink) const;
+
+	/// @brief
+	/// 	Determines whether a sink has thrown an exception.
+	/// @param
+	/// 	pElementSink - The element sink.
+	inline bool HasFailed(const ChainableUsbElementSink* pElementSink) const;
+
+public:
+	inline virtual void InitializeElementSink();
+	inline virtual void OnElementArrival(UsbElement* pElement);
+	inline virtual void FinalizeElementSink();
+
+protected:
+	/// @brief
+	/// 	Gets the count of element sinks.
+	inline size_t GetElementSinkCount() const;
+
+	/// @brief
+	/// 	Queues an USB element for one sink.
+	/// @param
+	/// 	index - The index of the sink, in their order of addition.
+	/// @param
+	/// 	pElement - The element to queue. A reference is added by the queue.
+	/// @seealso
+	/// 	SendToAllElementSinks
+	inline void SendToElementSink(size_t index, UsbElement* pElement);
+
+	/// @brief
+	/// 	Queues an USB element for all the sinks.
+	/// @param
+	/// 	pElement - The element to queue. A reference is added by each queue.
+	/// @seealso
+	/// 	SendToElementSink
+	inline void SendToAllElementSinks(UsbElement* pElement);
+
+	/// @brief
+	/// 	Throws the error of the first failed sink, if not already thrown.
+	inline void CheckElementSinkErrors();
+
+private:
+	inline const sink_worker* FindWorker(const ChainableUsbElementSink* pElementSink) const;
+	inline void StopWorkers();
+	inline void ThrowFirstError();
+	inline static void RunWorker(sink_worker& worker);
+	inline static DWORD WINAPI WorkerThreadProc(LPVOID pParameter);
+
+private:
+	ParallelUsbElementSinkManager(const ParallelUsbElementSinkManager&);
+	ParallelUsbElementSinkManager& operator=(const ParallelUsbElementSinkManager&);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// ShardedUsbElementSinkManager
+
+/// @brief
+/// 	Distributes the USB elements to several sinks running in parallel,
+/// 	according to their endpoint.
+/// @remarks
+/// 	Each sink is a shard running on its own worker thread, like with
+/// 	ParallelUsbElementSinkManager. The transactions are sent to a single
+/// 	shard, selected by a hash of their device address, endpoint number and
+/// 	direction, so all the transactions of an endpoint are received by the
+/// 	same shard in their arrival order. The endpoint 0 is bidirectional, so
+/// 	its both directions are sent to the same shard, as the Split and LPM
+/// 	transactions of a device.
+///
+/// 	The other elements, like UsbReset, UsbSuspended, UsbPowerChange,
+/// 	UsbTrigger or UsbStartOfFrame, concern the whole bus and are sent to
+/// 	all the shards, in their arrival order with the transactions.
+///
+/// 	GetElementShard can be overridden to distribute the elements otherwise.
+/// @seealso
+/// 	ParallelUsbElementSinkManager
+/// @sample
+/// \code
+/// usbdk::ShardedUsbElementSinkManager sinkManager;
+/// for(size_t i=0; i<shardCount; ++i)
+/// {
+///     sinkManager.AddElementSink(&myEndpointTrackers[i]);
+/// }
+///
+/// pAnalyzer->BeginAcquisition(&sinkManager);
+/// \endcode
+class ShardedUsbElementSinkManager : public ParallelUsbElementSinkManager
+{
+public:
+	/// Shard of the elements sent to all the shards.
+	static const size_t broadcastShard = (size_t) -1;
+
+public:
+	/// @brief
+	/// 	Constructs a ShardedUsbElementSinkManager object.
+	/// @seealso
+	/// 	~ShardedUsbElementSinkManager()
+	inline ShardedUsbElementSinkManager();
+
+	/// @brief
+	/// 	Destroys a ShardedUsbElementSinkManager object.
+	/// @seealso
+	/// 	ShardedUsbElementSinkManager()
+	inline virtual ~ShardedUsbElementSinkManager();
+
+public:
+	/// @brief
+	/// 	Gets the shard of an endpoint.
+	/// @param
+	/// 	address - The device address.
+	/// @param
+	/// 	endpoint - The endpoint number.
+	/// @param
+	/// 	directionIn - true for an IN endpoint, false for an OUT endpoint.
+	/// @param
+	/// 	shardCount - The count of shards.
+	/// @return
+	/// 	The index of the shard, lower than shardCount.
+	inline static size_t GetEndpointShard(usb_device_address address, usb_endpoint_number endpoint, bool directionIn, size_t shardCount);
+
+protected:
+	/// @brief
+	/// 	Selects the shard receiving an USB element.
+	/// @param
+	/// 	pElement - The element to send.
+	/// @param
+	/// 	shardCount - The count of shards.
+	/// @return
+	/// 	The index of the shard, lower than shardCount, or broadcastShard.
+	inline virtual size_t GetElementShard(const UsbElement* pElement, size_t shardCount) const;
+
+public:
+	inline virtual void OnElementArrival(UsbElement* pElement);
+};
+
+} // End of the usbdk namespace
+
+#include "ParallelUsbElementSinkManager.inl"
@@ -0,0 +1,403 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "ParallelUsbElementSinkManager.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// ParallelUsbElementSinkManager
+//---------------------------------------------------------------
+
+ParallelUsbElementSinkManager::ParallelUsbElementSinkManager() :
+	m_capacity(UsbElementSinkAsync::defaultCapacity),
+	m_overflowPolicy(overflowBlock),
+	m_hasFailed(0),
+	m_isErrorThrown(false)
+{
+}
+
+ParallelUsbElementSinkManager::~ParallelUsbElementSinkManager()
+{
+	StopWorkers();
+	ClearElementSinks();
+}
+
+void ParallelUsbElementSinkManager::AddElementSink(ChainableUsbElementSink* pElementSink)
+{
+	// The workers are allocated, so their address given to their thread is stable
+	sink_worker* pWorker = new sink_worker;
+	pWorker->pSink = pElementSink;
+	pWorker->pQueue = NULL;
+	pWorker->hThread = NULL;
+	pWorker->peakLag = 0;
+	pWorker->droppedCount = 0;
+	pWorker->hasFailed = 0;
+	pWorker->pHasAnyFailed = &m_hasFailed;
+	pWorker->error = sinkErrorNone;
+
+	m_workers.push_back(pWorker);
+}
+
+void ParallelUsbElementSinkManager::RemoveElementSink(ChainableUsbElementSink* pElementSink)
+{
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		if((*it)->pSink == pElementSink)
+		{
+			ASSERT((*it)->hThread == NULL);
+			delete (*it)->pQueue;
+			delete *it;
+
+			m_workers.erase(it);
+			return;
+		}
+	}
+}
+
+void ParallelUsbElementSinkManager::ClearElementSinks()
+{
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		ASSERT((*it)->hThread == NULL);
+		delete (*it)->pQueue;
+		delete *it;
+	}
+
+	m_workers.clear();
+}
+
+void ParallelUsbElementSinkManager::SetCapacity(size_t capacity)
+{
+	m_capacity = capacity;
+}
+
+size_t ParallelUsbElementSinkManager::GetCapacity() const
+{
+	return m_capacity;
+}
+
+void ParallelUsbElementSinkManager::SetOverflowPolicy(usb_overflow_policy policy)
+{
+	m_overflowPolicy = policy;
+}
+
+usb_overflow_policy ParallelUsbElementSinkManager::GetOverflowPolicy() const
+{
+	return m_overflowPolicy;
+}
+
+size_t ParallelUsbElementSinkManager::GetLag(const ChainableUsbElementSink* pElementSink) const
+{
+	const sink_worker* pWorker = FindWorker(pElementSink);
+	return ((pWorker != NULL) && (pWorker->pQueue != NULL)) ? pWorker->pQueue->GetCount() : 0;
+}
+
+size_t ParallelUsbElementSinkManager::GetPeakLag(const ChainableUsbElementSink* pElementSink) const
+{
+	const sink_worker* pWorker = FindWorker(pElementSink);
+	return (pWorker != NULL) ? pWorker->peakLag : 0;
+}
+
+size_t ParallelUsbElementSinkManager::GetDroppedCount(const ChainableUsbElementSink* pElementSink) const
+{
+	const sink_worker* pWorker = FindWorker(pElementSink);
+	return (pWorker != NULL) ? pWorker->droppedCount : 0;
+}
+
+bool ParallelUsbElementSinkManager::HasFailed(const ChainableUsbElementSink* pElementSink) const
+{
+	const sink_worker* pWorker = FindWorker(pElementSink);
+	return (pWorker != NULL) && (pWorker->hasFailed != 0);
+}
+
+void ParallelUsbElementSinkManager::InitializeElementSink()
+{
+	StopWorkers();
+
+	m_hasFailed = 0;
+	m_isErrorThrown = false;
+
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		delete (*it)->pQueue;
+		(*it)->pQueue = new UsbElementQueue(m_capacity);
+		(*it)->peakLag = 0;
+		(*it)->droppedCount = 0;
+		(*it)->hasFailed = 0;
+		(*it)->error = sinkErrorNone;
+		(*it)->exceptionMessage.clear();
+		(*it)->stringMessage.clear();
+
+		(*it)->pSink->InitializeElementSink();
+	}
+
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		(*it)->hThread = CreateThread(NULL, 0, WorkerThreadProc, *it, 0, NULL);
+		ASSERT((*it)->hThread != NULL);
+	}
+}
+
+void ParallelUsbElementSinkManager::OnElementArrival(UsbElement* pElement)
+{
+	CheckElementSinkErrors();
+	SendToAllElementSinks(pElement);
+}
+
+void ParallelUsbElementSinkManager::FinalizeElementSink()
+{
+	StopWorkers();
+
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		(*it)->pSink->FinalizeElementSink();
+	}
+
+	CheckElementSinkErrors();
+}
+
+size_t ParallelUsbElementSinkManager::GetElementSinkCount() const
+{
+	return m_workers.size();
+}
+
+void ParallelUsbElementSinkManager::SendToElementSink(size_t index, UsbElement* pElement)
+{
+	sink_worker& worker = *m_workers[index];
+
+	if((worker.hThread == NULL) || (worker.hasFailed != 0))
+	{
+		return;
+	}
+
+	pElement->AddRef();
+
+	if(m_overflowPolicy == overflowBlock)
+	{
+		worker.pQueue->Push(pElement);
+	}
+	else if(!worker.pQueue->TryPush(pElement))
+	{
+		pElement->Release();
+		++worker.droppedCount;
+		return;
+	}
+
+	size_t lag = worker.pQueue->GetCount();
+
+	if(lag > worker.peakLag)
+	{
+		worker.peakLag = lag;
+	}
+}
+
+void ParallelUsbElementSinkManager::SendToAllElementSinks(UsbElement* pElement)
+{
+	const size_t count = m_workers.size();
+
+	for(size_t i=0; i<count; ++i)
+	{
+		SendToElementSink(i, pElement);
+	}
+}
+
+void ParallelUsbElementSinkManager::CheckElementSinkErrors()
+{
+	if((m_hasFailed != 0) && !m_isErrorThrown)
+	{
+		ThrowFirstError();
+	}
+}
+
+const ParallelUsbElementSinkManager::sink_worker* ParallelUsbElementSinkManager::FindWorker(const ChainableUsbElementSink* pElementSink) const
+{
+	for(vector_sink_worker::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		if((*it)->pSink == pElementSink)
+		{
+			return *it;
+		}
+	}
+
+	return NULL;
+}
+
+void ParallelUsbElementSinkManager::StopWorkers()
+{
+	// All the queues are closed first, so the workers drain them in parallel
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		if((*it)->hThread != NULL)
+		{
+			(*it)->pQueue->Close();
+		}
+	}
+
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		if((*it)->hThread != NULL)
+		{
+			WaitForSingleObject((*it)->hThread, INFINITE);
+			CloseHandle((*it)->hThread);
+			(*it)->hThread = NULL;
+		}
+	}
+}
+
+void ParallelUsbElementSinkManager::ThrowFirstError()
+{
+	for(vector_sink_worker::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+	{
+		if((*it)->hasFailed == 0)
+		{
+			continue;
+		}
+
+		m_isErrorThrown = true;
+
+		switch((*it)->error)
+		{
+		case sinkErrorException:
+			throw std::runtime_error((*it)->exceptionMessage);
+
+		case sinkErrorString:
+			throw (*it)->stringMessage;
+
+		default:
+			throw std::runtime_error("Unknown error in an USB element sink");
+		}
+	}
+}
+
+void ParallelUsbElementSinkManager::RunWorker(sink_worker& worker)
+{
+	UsbElement* pElement;
+
+	while(worker.pQueue->Pop(pElement))
+	{
+		if(worker.hasFailed == 0)
+		{
+			try
+			{
+				worker.pSink->OnElementArrival(pElement);
+			}
+			catch(std::exception& e)
+			{
+				worker.error = sinkErrorException;
+				worker.exceptionMessage = e.what();
+			}
+			catch(std::tstring& s)
+			{
+				worker.error = sinkErrorString;
+				worker.stringMessage = s;
+			}
+			catch(...)
+			{
+				worker.error = sinkErrorUnknown;
+			}
+
+			if(worker.error != sinkErrorNone)
+			{
+				// The error is set before the failure is visible to the acquisition thread
+				InterlockedExchange(&worker.hasFailed, 1);
+				InterlockedExchange(worker.pHasAnyFailed, 1);
+			}
+		}
+
+		pElement->Release();
+	}
+}
+
+DWORD WINAPI ParallelUsbElementSinkManager::WorkerThreadProc(LPVOID pParameter)
+{
+	RunWorker(*static_cast<sink_worker*>(pParameter));
+	return 0;
+}
+
+//---------------------------------------------------------------
+// ShardedUsbElementSinkManager
+//---------------------------------------------------------------
+
+ShardedUsbElementSinkManager::ShardedUsbElementSinkManager()
+{
+}
+
+ShardedUsbElementSinkManager::~ShardedUsbElementSinkManager()
+{
+}
+
+size_t ShardedUsbElementSinkManager::GetEndpointShard(usb_device_address address, usb_endpoint_number endpoint, bool directionIn, size_t shardCount)
+{
+	ASSERT(shardCount != 0);
+
+	// The endpoint 0 is bidirectional, its transfers must not be split
+	if(endpoint == 0)
+	{
+		directionIn = false;
+	}
+
+	const DWORD key = ((DWORD) address << 5) | ((DWORD) (endpoint & 0x0F) << 1) | (directionIn ? 1 : 0);
+
+	// Fibonacci hashing spreads the consecutive keys over the shards
+	return (size_t) (((key * 2654435761UL) & 0xFFFFFFFF) >> 16) % shardCount;
+}
+
+size_t ShardedUsbElementSinkManager::GetElementShard(const UsbElement* pElement, size_t shardCount) const
+{
+	switch(pElement->GetElementType())
+	{
+	case elementTransaction:
+		{
+			const UsbTransaction* pTransaction = static_cast<const UsbTransaction*>(pElement);
+			return GetEndpointShard(pTransaction->GetDeviceAddress(), pTransaction->GetEndpointNumber(), pTransaction->GetTokenPacket().GetPID() == pidIN, shardCount);
+		}
+
+	case elementSplitTransaction:
+		{
+			const UsbSplitTransaction* pSplitTransaction = static_cast<const UsbSplitTransaction*>(pElement);
+			return GetEndpointShard(pSplitTransaction->GetTokenDeviceAddress(), pSplitTransaction->GetTokenEndpointNumber(), pSplitTransaction->GetTokenPacket().GetPID() == pidIN, shardCount);
+		}
+
+	case elementLpmTransaction:
+		return GetEndpointShard(static_cast<const UsbLpmTransaction*>(pElement)->GetDeviceAddress(), 0, false, shardCount);
+	}
+
+	return broadcastShard;
+}
+
+void ShardedUsbElementSinkManager::OnElementArrival(UsbElement* pElement)
+{
+	CheckElementSinkErrors();
+
+	const size_t shardCount = GetElementSinkCount();
+
+	if(shardCount == 0)
+	{
+		return;
+	}
+
+	const size_t shard = GetElementShard(pElement, shardCount);
+
+	if(shard == broadcastShard)
+	{
+		SendToAllElementSinks(pElement);
+	}
+	else
+	{
+		SendToElementSink(shard, pElement);
+	}
+}
+
+}
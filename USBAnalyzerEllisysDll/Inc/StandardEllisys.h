@@ -63,6 +63,13 @@
 #	endif
 #endif
 
+// Rvalue references (move semantics) are available since Microsoft Visual C++ 2010
+#ifndef ELLISYS_HAS_RVALUE_REFERENCES
+#	if (defined(_MSC_VER) && (_MSC_VER >= 1600)) || (__cplusplus >= 201103L)
+#		define ELLISYS_HAS_RVALUE_REFERENCES
+#	endif
+#endif
+
 // Use macro "HERE" with the following form:
 // #pragma message(HERE "Warning: XXX")
 #define LINE_STRING_1(x)  #x
@@ -27,10 +27,22 @@ namespace usbdk { }
 #include "UsbTypes.h"
 #include "UsbCrc.h"
 #include "UsbPackets.h"
+#include "UsbPacketValidator.h"
 #include "UsbElements.h"
 #include "UsbElementFactory.h"
 #include "UsbElementSink.h"
 #include "UsbElementInjector.h"
+#include "UsbElementColumnarStore.h"
+#include "UsbElementRingBuffer.h"
+#include "UsbElementBudgetStorage.h"
+#include "UsbFrameIndex.h"
+#include "UsbElementRunCollapser.h"
+#include "UsbElementErrorsCache.h"
+#include "UsbElementSinkAsync.h"
+#include "ParallelUsbElementSinkManager.h"
+#include "UsbTransfers.h"
+#include "UsbDescriptorCache.h"
+#include "UsbBandwidthMeter.h"
 #include "UsbAnalyzer.h"
 #include "Version.h"
 
@@ -0,0 +1,263 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbBandwidthMeter.h
+/// @brief
+///		USB Analysis SDK bandwidth meter declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/// @brief
+///		Bus occupancy of a frame or of a micro-frame.
+/// @remarks
+///		The occupancy is in bit-times of the link: a high speed micro-frame
+///		lasts 60000 bit-times and a full speed frame 12000 bit-times.
+/// @seealso
+///		UsbBandwidthMeter
+struct usb_frame_bandwidth
+{
+	/// Frame number of the Start-of-Frame beginning the interval.
+	usb_frame_number frameNumber;
+
+	/// Micro-frame number of the Start-of-Frame, or no_microframe_number.
+	usb_microframe_number microFrameNumber;
+
+	/// Speed of the link.
+	usb_speed speed;
+
+	/// Time of the Start-of-Frame beginning the interval.
+	usb_ticks ticks;
+
+	/// Bit-times of the interval.
+	DWORD capacityBitTimes;
+
+	/// Bit-times used by all the packets of the interval.
+	DWORD totalBitTimes;
+
+	/// Bit-times used by the isochronous and interrupt transactions.
+	DWORD periodicBitTimes;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbBandwidthMeter
+
+/// @brief
+/// 	Measures the bus occupancy of each frame or micro-frame.
+/// @remarks
+/// 	The transactions, split transactions and LPM transactions are charged
+/// 	to the interval begun by the last Start-of-Frame. The bit-times of a
+/// 	packet are computed from the size of its raw data and its speed, with
+/// 	the worst case bit stuffing, the SYNC and EOP fields, and the maximum
+/// 	inter-packet delay. A low speed packet on a full speed link is charged
+/// 	8 full speed bit-times per bit and its preamble. The elements before
+/// 	the first Start-of-Frame and after a reset are not charged.
+///
+/// 	When an interval ends, it is stored in a rolling window of the last
+/// 	intervals and given to ProcessFrameBandwidth. An interval whose
+/// 	periodic occupancy is over the periodic limit, 80% of the interval by
+/// 	default, is counted as saturated. Nothing else is kept, so the meter
+/// 	can run during an acquisition without storing it.
+///
+/// 	The split transactions give their endpoint type. The other
+/// 	transactions are periodic when GetTransferType says so. When it does
+/// 	not know the endpoint, which is the default, the transactions without
+/// 	handshake are taken as isochronous. A bulk transaction whose handshake
+/// 	timed out or was corrupted is then charged as periodic, so give the
+/// 	transfer types with GetTransferType to avoid false saturations.
+/// @seealso
+/// 	usb_frame_bandwidth, UsbDescriptorCache
+/// @sample
+/// \code
+/// class PeriodicWatch : public usbdk::UsbBandwidthMeter
+/// {
+/// public:
+///     const usbdk::UsbDescriptorCache* m_pCache;
+///
+/// protected:
+///     virtual bool GetTransferType(usbdk::usb_device_address deviceAddress,
+///         usbdk::usb_endpoint_number endpointNumber, bool isDirectionIn, usbdk::transfer_type& type) const
+///     {
+///         return m_pCache->GetTransferType(deviceAddress, endpointNumber, isDirectionIn, type);
+///     }
+///
+///     virtual void ProcessFrameBandwidth(const usbdk::usb_frame_bandwidth& bandwidth)
+///     {
+///         if(IsSaturated(bandwidth))
+///         {
+///             _tprintf(_T("Frame %d.%d saturated\n"), bandwidth.frameNumber, bandwidth.microFrameNumber);
+///         }
+///     }
+/// };
+/// \endcode
+class UsbBandwidthMeter : public UsbElementVisitor<UsbBandwidthMeter>
+{
+	friend class UsbElementVisitor<UsbBandwidthMeter>;
+
+public:
+	enum
+	{
+		defaultWindowSize = 64,		///< Default count of intervals of the rolling window
+		defaultPeriodicLimit = 80,	///< Default periodic limit, in percent of the interval
+	};
+
+private:
+	enum
+	{
+		highSpeedMicroFrameBitTimes = 60000,	// 480 Mbps during 125 us
+		fullSpeedFrameBitTimes = 12000,			// 12 Mbps during 1 ms
+
+		// SYNC, EOP and maximum inter-packet delay
+		highSpeedPacketOverhead = 32 + 8 + 192,
+		fullSpeedPacketOverhead = 8 + 3 + 16,
+
+		// PRE packet and hub setup in full speed bit-times
+		lowSpeedPreambleOverhead = 16 + 4,
+		lowSpeedBitTimes = 8,
+	};
+
+	std::vector<usb_frame_bandwidth> m_window;
+	size_t m_windowSize;
+	size_t m_windowStart;
+	size_t m_windowCount;
+	DWORD m_periodicLimit;
+	bool m_isFrameOpen;
+	usb_frame_bandwidth m_frame;
+	DWORDLONG m_frameCount;
+	DWORDLONG m_saturatedCount;
+	DWORD m_peakPeriodicBitTimes;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbBandwidthMeter object.
+	/// @seealso
+	/// 	~UsbBandwidthMeter()
+	inline UsbBandwidthMeter();
+
+	/// @brief
+	/// 	Destroys a UsbBandwidthMeter object.
+	/// @seealso
+	/// 	UsbBandwidthMeter()
+	inline virtual ~UsbBandwidthMeter();
+
+public:
+	/// @brief
+	/// 	Sets the count of intervals of the rolling window.
+	/// @remarks
+	/// 	The size is used by the next call to InitializeElementSink. The
+	/// 	default size is defaultWindowSize.
+	inline void SetWindowSize(size_t size);
+
+	/// @brief
+	/// 	Gets the count of intervals of the rolling window.
+	inline size_t GetWindowSize() const;
+
+	/// @brief
+	/// 	Sets the periodic limit.
+	/// @param
+	/// 	percent - The limit, in percent of the interval. The default limit
+	/// 	is defaultPeriodicLimit.
+	inline void SetPeriodicLimit(DWORD percent);
+
+	/// @brief
+	/// 	Gets the periodic limit, in percent of the interval.
+	inline DWORD GetPeriodicLimit() const;
+
+	/// @brief
+	/// 	Determines whether the periodic occupancy of an interval is over the limit.
+	inline bool IsSaturated(const usb_frame_bandwidth& bandwidth) const;
+
+public:
+	/// @brief
+	/// 	Gets the count of ended intervals in the rolling window.
+	inline size_t GetWindowCount() const;
+
+	/// @brief
+	/// 	Gets an ended interval of the rolling window.
+	/// @param
+	/// 	index - The index of the interval, from the oldest one, lower than GetWindowCount.
+	inline const usb_frame_bandwidth& GetWindowFrame(size_t index) const;
+
+	/// @brief
+	/// 	Gets the count of ended intervals since InitializeElementSink.
+	inline DWORDLONG GetFrameCount() const;
+
+	/// @brief
+	/// 	Gets the count of saturated intervals since InitializeElementSink.
+	inline DWORDLONG GetSaturatedCount() const;
+
+	/// @brief
+	/// 	Gets the highest periodic occupancy of an interval since InitializeElementSink.
+	inline DWORD GetPeakPeriodicBitTimes() const;
+
+	/// @brief
+	/// 	Gets the bit-times used by a packet and the delay before the next one.
+	/// @remarks
+	/// 	The high speed packets are counted in high speed bit-times, the
+	/// 	other packets in full speed bit-times.
+	/// @param
+	/// 	packet - The packet.
+	/// @return
+	/// 	The bit-times, or 0 for an empty packet.
+	inline static DWORD GetPacketBitTimes(const UsbPacket& packet);
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	The window and the counters are cleared. A derived class overriding
+	/// 	this method must call it.
+	inline virtual void InitializeElementSink();
+
+	/// @brief
+	/// 	Finalizes the sink.
+	/// @remarks
+	/// 	The current interval is ended. A derived class overriding this
+	/// 	method must call it.
+	inline virtual void FinalizeElementSink();
+
+protected:
+	/// @brief
+	/// 	Processes an ended interval.
+	/// @remarks
+	/// 	The default implementation does nothing.
+	/// @param
+	/// 	bandwidth - The occupancy of the interval.
+	inline virtual void ProcessFrameBandwidth(const usb_frame_bandwidth& bandwidth);
+
+	/// @brief
+	/// 	Gets the transfer type of an endpoint.
+	/// @remarks
+	/// 	The default implementation returns false.
+	/// @param
+	/// 	deviceAddress - The address of the device.
+	/// @param
+	/// 	endpointNumber - The number of the endpoint.
+	/// @param
+	/// 	isDirectionIn - The direction of the endpoint.
+	/// @param
+	/// 	type - Receives the transfer type.
+	/// @return
+	/// 	true if the transfer type is known.
+	inline virtual bool GetTransferType(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn, transfer_type& type) const;
+
+	inline void ProcessStartOfFrame(UsbStartOfFrame* pStartOfFrame);
+	inline void ProcessTransaction(UsbTransaction* pTransaction);
+	inline void ProcessSplitTransaction(UsbSplitTransaction* pSplitTransaction);
+	inline void ProcessLpmTransaction(UsbLpmTransaction* pLpmTransaction);
+	inline void ProcessReset(UsbReset* pReset);
+
+private:
+	inline void EndFrame();
+};
+
+} // End of the usbdk namespace
+
+#include "UsbBandwidthMeter.inl"
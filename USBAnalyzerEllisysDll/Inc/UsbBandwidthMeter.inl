@@ -0,0 +1,284 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbBandwidthMeter.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbBandwidthMeter
+//---------------------------------------------------------------
+
+UsbBandwidthMeter::UsbBandwidthMeter() :
+	m_window(defaultWindowSize),
+	m_windowSize(defaultWindowSize),
+	m_windowStart(0),
+	m_windowCount(0),
+	m_periodicLimit(defaultPeriodicLimit),
+	m_isFrameOpen(false),
+	m_frameCount(0),
+	m_saturatedCount(0),
+	m_peakPeriodicBitTimes(0)
+{
+	memset(&m_frame, 0, sizeof(m_frame));
+}
+
+UsbBandwidthMeter::~UsbBandwidthMeter()
+{
+}
+
+void UsbBandwidthMeter::SetWindowSize(size_t size)
+{
+	m_windowSize = (size > 0) ? size : 1;
+}
+
+size_t UsbBandwidthMeter::GetWindowSize() const
+{
+	return m_windowSize;
+}
+
+void UsbBandwidthMeter::SetPeriodicLimit(DWORD percent)
+{
+	m_periodicLimit = percent;
+}
+
+DWORD UsbBandwidthMeter::GetPeriodicLimit() const
+{
+	return m_periodicLimit;
+}
+
+bool UsbBandwidthMeter::IsSaturated(const usb_frame_bandwidth& bandwidth) const
+{
+	return ((DWORDLONG) bandwidth.periodicBitTimes * 100) > ((DWORDLONG) bandwidth.capacityBitTimes * m_periodicLimit);
+}
+
+size_t UsbBandwidthMeter::GetWindowCount() const
+{
+	return m_windowCount;
+}
+
+const usb_frame_bandwidth& UsbBandwidthMeter::GetWindowFrame(size_t index) const
+{
+	return m_window[(m_windowStart + index) % m_window.size()];
+}
+
+DWORDLONG UsbBandwidthMeter::GetFrameCount() const
+{
+	return m_frameCount;
+}
+
+DWORDLONG UsbBandwidthMeter::GetSaturatedCount() const
+{
+	return m_saturatedCount;
+}
+
+DWORD UsbBandwidthMeter::GetPeakPeriodicBitTimes() const
+{
+	return m_peakPeriodicBitTimes;
+}
+
+DWORD UsbBandwidthMeter::GetPacketBitTimes(const UsbPacket& packet)
+{
+	if(packet.IsEmpty())
+	{
+		return 0;
+	}
+
+	// Worst case bit stuffing, one stuffed bit every six bits
+	const DWORD bitCount = (DWORD) packet.GetRawData().size() * 8;
+	const DWORD stuffedBitCount = (bitCount * 7 + 5) / 6;
+
+	switch(packet.GetSpeed())
+	{
+	case speedHigh:
+		return stuffedBitCount + highSpeedPacketOverhead;
+
+	case speedFull:
+		return stuffedBitCount + fullSpeedPacketOverhead;
+
+	case speedLow:
+		return (stuffedBitCount + fullSpeedPacketOverhead) * lowSpeedBitTimes;
+
+	case speedLowPrefixed:
+		return (stuffedBitCount + fullSpeedPacketOverhead) * lowSpeedBitTimes + lowSpeedPreambleOverhead;
+	}
+
+	return 0;
+}
+
+void UsbBandwidthMeter::InitializeElementSink()
+{
+	m_window.assign(m_windowSize, usb_frame_bandwidth());
+	m_windowStart = 0;
+	m_windowCount = 0;
+	m_isFrameOpen = false;
+	m_frameCount = 0;
+	m_saturatedCount = 0;
+	m_peakPeriodicBitTimes = 0;
+}
+
+void UsbBandwidthMeter::FinalizeElementSink()
+{
+	EndFrame();
+}
+
+void UsbBandwidthMeter::ProcessFrameBandwidth(const usb_frame_bandwidth&)
+{
+}
+
+bool UsbBandwidthMeter::GetTransferType(usb_device_address, usb_endpoint_number, bool, transfer_type&) const
+{
+	return false;
+}
+
+void UsbBandwidthMeter::ProcessStartOfFrame(UsbStartOfFrame* pStartOfFrame)
+{
+	EndFrame();
+
+	const usb_speed speed = pStartOfFrame->GetSpeed();
+
+	if((speed != speedHigh) && (speed != speedFull))
+	{
+		return;
+	}
+
+	m_frame.frameNumber = pStartOfFrame->GetFrameNumber();
+	m_frame.microFrameNumber = pStartOfFrame->GetMicroFrameNumber();
+	m_frame.speed = speed;
+	m_frame.ticks = pStartOfFrame->GetTicks();
+	m_frame.capacityBitTimes = (speed == speedHigh) ? highSpeedMicroFrameBitTimes : fullSpeedFrameBitTimes;
+	m_frame.totalBitTimes = GetPacketBitTimes(pStartOfFrame->GetPacket());
+	m_frame.periodicBitTimes = 0;
+	m_isFrameOpen = true;
+}
+
+void UsbBandwidthMeter::ProcessTransaction(UsbTransaction* pTransaction)
+{
+	if(!m_isFrameOpen)
+	{
+		return;
+	}
+
+	const UsbPacketToken& token = pTransaction->GetTokenPacket();
+	const UsbPacketHandshake& handshake = pTransaction->GetHandshakePacket();
+
+	const DWORD bitTimes =
+		GetPacketBitTimes(token) +
+		GetPacketBitTimes(pTransaction->GetDataPacket()) +
+		GetPacketBitTimes(handshake);
+
+	m_frame.totalBitTimes += bitTimes;
+
+	const usb_pid tokenPid = token.GetPID();
+	bool isPeriodic = false;
+
+	if(tokenPid != pidSETUP)
+	{
+		transfer_type type;
+
+		if(GetTransferType(token.GetDeviceAddress(), token.GetEndpointNumber(), tokenPid == pidIN, type))
+		{
+			isPeriodic = (type == transferIsochronous) || (type == transferInterrupt);
+		}
+		else
+		{
+			// Only the isochronous transactions have no handshake, unless
+			// the handshake is missing, like after a timeout
+			isPeriodic = handshake.IsEmpty();
+		}
+	}
+
+	if(isPeriodic)
+	{
+		m_frame.periodicBitTimes += bitTimes;
+	}
+}
+
+void UsbBandwidthMeter::ProcessSplitTransaction(UsbSplitTransaction* pSplitTransaction)
+{
+	if(!m_isFrameOpen)
+	{
+		return;
+	}
+
+	const DWORD bitTimes =
+		GetPacketBitTimes(pSplitTransaction->GetSplitPacket()) +
+		GetPacketBitTimes(pSplitTransaction->GetTokenPacket()) +
+		GetPacketBitTimes(pSplitTransaction->GetDataPacket()) +
+		GetPacketBitTimes(pSplitTransaction->GetHandshakePacket());
+
+	m_frame.totalBitTimes += bitTimes;
+
+	const usb_split_endpoint_type endpointType = pSplitTransaction->GetSplitEndpointType();
+
+	if((endpointType == splitEndpointTypeIsochronous) || (endpointType == splitEndpointTypeInterrupt))
+	{
+		m_frame.periodicBitTimes += bitTimes;
+	}
+}
+
+void UsbBandwidthMeter::ProcessLpmTransaction(UsbLpmTransaction* pLpmTransaction)
+{
+	if(!m_isFrameOpen)
+	{
+		return;
+	}
+
+	m_frame.totalBitTimes +=
+		GetPacketBitTimes(pLpmTransaction->GetTokenPacket()) +
+		GetPacketBitTimes(pLpmTransaction->GetExtTokenPacket()) +
+		GetPacketBitTimes(pLpmTransaction->GetHandshakePacket());
+}
+
+void UsbBandwidthMeter::ProcessReset(UsbReset*)
+{
+	EndFrame();
+}
+
+void UsbBandwidthMeter::EndFrame()
+{
+	if(!m_isFrameOpen)
+	{
+		return;
+	}
+
+	m_isFrameOpen = false;
+	++m_frameCount;
+
+	if(m_frame.periodicBitTimes > m_peakPeriodicBitTimes)
+	{
+		m_peakPeriodicBitTimes = m_frame.periodicBitTimes;
+	}
+
+	if(IsSaturated(m_frame))
+	{
+		++m_saturatedCount;
+	}
+
+	// The oldest interval is overwritten when the window is full
+	if(m_windowCount < m_window.size())
+	{
+		m_window[(m_windowStart + m_windowCount) % m_window.size()] = m_frame;
+		++m_windowCount;
+	}
+	else
+	{
+		m_window[m_windowStart] = m_frame;
+		m_windowStart = (m_windowStart + 1) % m_window.size();
+	}
+
+	ProcessFrameBandwidth(m_frame);
+}
+
+}
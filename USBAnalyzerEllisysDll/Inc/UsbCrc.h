@@ -17,6 +17,77 @@
 
 namespace usbdk {
 
+//////////////////////////////////////////////////////////////////////
+// usb_crc16_slice and usb_crc5_entry
+
+/// @brief
+///		Computes the reflected CRC-16 of a value shifted by a count of bits at compile time.
+/// @remarks
+///		The USB CRC-16 polynomial is x^16 + x^15 + x^2 + 1, 0xA001 once reflected.
+template<DWORD Crc, int BitCount>
+struct usb_crc16_bits
+{
+	enum { value = usb_crc16_bits<((Crc & 1) != 0) ? ((Crc >> 1) ^ 0xA001) : (Crc >> 1), BitCount - 1>::value };
+};
+
+template<DWORD Crc>
+struct usb_crc16_bits<Crc, 0>
+{
+	enum { value = Crc };
+};
+
+/// @brief
+///		Computes an entry of the slicing-by-8 CRC-16 tables at compile time.
+/// @remarks
+///		The slice 0 is the classic byte table. The slice N gives the CRC-16 of
+///		a byte followed by N zero bytes.
+template<DWORD Index, int Slice>
+struct usb_crc16_slice
+{
+	enum { previous = usb_crc16_slice<Index, Slice - 1>::value };
+	enum { value = (previous >> 8) ^ usb_crc16_slice<previous & 0xFF, 0>::value };
+};
+
+template<DWORD Index>
+struct usb_crc16_slice<Index, 0>
+{
+	enum { value = usb_crc16_bits<Index, 8>::value };
+};
+
+/// @brief
+///		Computes the USB CRC-5 of the first bits of a value at compile time.
+/// @remarks
+///		The bits are taken from the least significant one, in their order on
+///		the bus. The USB CRC-5 polynomial is x^5 + x^2 + 1, 0x14 once reflected.
+template<DWORD Data, int BitCount, DWORD Crc = 0x1F>
+struct usb_crc5_of
+{
+	enum { value = usb_crc5_of<(Data >> 1), BitCount - 1, (((Crc ^ Data) & 1) != 0) ? ((Crc >> 1) ^ 0x14) : (Crc >> 1)>::value };
+};
+
+template<DWORD Data, DWORD Crc>
+struct usb_crc5_of<Data, 0, Crc>
+{
+	enum { value = Crc ^ 0x1F };
+};
+
+/// @brief
+///		Computes an entry of the CRC-5 tables at compile time.
+/// @remarks
+///		The CRC-5 of a value is the CRC-5 of its lowest set bit combined with
+///		the CRC-5 of the other bits, so each entry reuses a previous one.
+template<DWORD Data, int BitCount>
+struct usb_crc5_entry
+{
+	enum { value = usb_crc5_entry<(Data & (Data - 1)), BitCount>::value ^ usb_crc5_of<(Data & (0 - Data)), BitCount>::value ^ usb_crc5_of<0, BitCount>::value };
+};
+
+template<int BitCount>
+struct usb_crc5_entry<0, BitCount>
+{
+	enum { value = usb_crc5_of<0, BitCount>::value };
+};
+
 //////////////////////////////////////////////////////////////////////
 // UsbCRC
 
@@ -44,6 +115,9 @@ public:
 
 	/// @brief
 	///      Computes the USB CRC-16 on a STL compatible container.
+	/// @remarks
+	///      The CRC-16 is computed inline, eight bytes at a time with the
+	///      slicing-by-8 tables. The container must be contiguous.
 	/// @param
 	///      first - An iterator on the first element of the container.
 	/// @param
@@ -62,6 +136,26 @@ public:
 	}
 
 public:
+	/// @brief
+	///		Computes the USB CRC-5 of the 11 bits of a token or Start-of-Frame packet.
+	/// @remarks
+	///		The CRC-5 is read from a table of the compiler.
+	/// @param
+	///		data - The ADDR and ENDP fields, or the Frame Number field, the first bit in the least significant bit.
+	/// @return
+	///		The CRC-5 result.
+	inline static usb_crc5 ComputeUsbCRC5Of11Bits(WORD data);
+
+	/// @brief
+	///		Computes the USB CRC-5 of the 19 bits of a split packet.
+	/// @remarks
+	///		The CRC-5 is read from two tables of the compiler.
+	/// @param
+	///		data - The fields following the PID, the first bit in the least significant bit.
+	/// @return
+	///		The CRC-5 result.
+	inline static usb_crc5 ComputeUsbCRC5Of19Bits(DWORD data);
+
 	/// @brief
 	///		Computes the USB CRC-5 on an array of bytes.
 	/// @param
@@ -90,6 +184,16 @@ public:
 
 		return ComputeUsbCRC5Internal((const BYTE*) &(*first), (last-first) * 8);
 	}
+
+private:
+	inline static usb_crc16 ComputeUsbCRC16Internal(const BYTE* pData, size_t dataSize);
+	inline static const usb_crc16 (*GetUsbCRC16Tables())[256];
+	inline static usb_crc5 ComputeUsbCRC5Internal(const BYTE* pData, size_t bitCount);
+	inline static const usb_crc5* GetUsbCRC5Table11();
+	inline static const usb_crc5* GetUsbCRC5Table19Low();
+	inline static const usb_crc5* GetUsbCRC5Table19High();
 };
 
 } // End of the usbdk namespace
+
+#include "UsbCrc.inl"
@@ -0,0 +1,166 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbCrc.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbCRC
+//---------------------------------------------------------------
+
+usb_crc16 UsbCRC::ComputeUsbCRC16Internal(const BYTE* pData, size_t dataSize)
+{
+	const usb_crc16 (*tables)[256] = GetUsbCRC16Tables();
+	DWORD crc = 0xFFFF;
+
+	// Eight bytes per step, the CRC only overlaps the first two
+	while(dataSize >= 8)
+	{
+		crc =
+			tables[7][pData[0] ^ (crc & 0xFF)] ^
+			tables[6][pData[1] ^ (crc >> 8)] ^
+			tables[5][pData[2]] ^
+			tables[4][pData[3]] ^
+			tables[3][pData[4]] ^
+			tables[2][pData[5]] ^
+			tables[1][pData[6]] ^
+			tables[0][pData[7]];
+
+		pData += 8;
+		dataSize -= 8;
+	}
+
+	while(dataSize > 0)
+	{
+		crc = (crc >> 8) ^ tables[0][(crc ^ *pData) & 0xFF];
+
+		++pData;
+		--dataSize;
+	}
+
+	return (usb_crc16) (crc ^ 0xFFFF);
+}
+
+usb_crc5 UsbCRC::ComputeUsbCRC5Of11Bits(WORD data)
+{
+	return GetUsbCRC5Table11()[data & 0x07FF];
+}
+
+usb_crc5 UsbCRC::ComputeUsbCRC5Of19Bits(DWORD data)
+{
+	// The CRC-5 is linear, the low and high bits are looked up apart
+	return GetUsbCRC5Table19Low()[data & 0x07FF] ^ GetUsbCRC5Table19High()[(data >> 11) & 0xFF];
+}
+
+usb_crc5 UsbCRC::ComputeUsbCRC5Internal(const BYTE* pData, size_t bitCount)
+{
+	if(bitCount == 11)
+	{
+		return ComputeUsbCRC5Of11Bits((WORD) (pData[0] | (pData[1] << 8)));
+	}
+
+	if(bitCount == 19)
+	{
+		return ComputeUsbCRC5Of19Bits(pData[0] | (pData[1] << 8) | ((DWORD) pData[2] << 16));
+	}
+
+	BYTE crc = 0x1F;
+
+	for(size_t i=0; i<bitCount; ++i)
+	{
+		const BYTE bit = (pData[i / 8] >> (i % 8)) & 1;
+		crc = ((crc ^ bit) & 1) ? ((crc >> 1) ^ 0x14) : (crc >> 1);
+	}
+
+	return (usb_crc5) (crc ^ 0x1F);
+}
+
+// The tables are computed by the compiler, they are constant data
+// without any initialization at run time
+
+#define USB_CRC_TABLE_4(entry, arg, index) \
+	entry(arg, (index)), entry(arg, (index) + 1), entry(arg, (index) + 2), entry(arg, (index) + 3)
+
+#define USB_CRC_TABLE_16(entry, arg, index) \
+	USB_CRC_TABLE_4(entry, arg, (index)), USB_CRC_TABLE_4(entry, arg, (index) + 4), \
+	USB_CRC_TABLE_4(entry, arg, (index) + 8), USB_CRC_TABLE_4(entry, arg, (index) + 12)
+
+#define USB_CRC_TABLE_64(entry, arg, index) \
+	USB_CRC_TABLE_16(entry, arg, (index)), USB_CRC_TABLE_16(entry, arg, (index) + 16), \
+	USB_CRC_TABLE_16(entry, arg, (index) + 32), USB_CRC_TABLE_16(entry, arg, (index) + 48)
+
+#define USB_CRC_TABLE_256(entry, arg, index) \
+	USB_CRC_TABLE_64(entry, arg, (index)), USB_CRC_TABLE_64(entry, arg, (index) + 64), \
+	USB_CRC_TABLE_64(entry, arg, (index) + 128), USB_CRC_TABLE_64(entry, arg, (index) + 192)
+
+#define USB_CRC_TABLE_2048(entry, arg) \
+	USB_CRC_TABLE_256(entry, arg, 0), USB_CRC_TABLE_256(entry, arg, 256), \
+	USB_CRC_TABLE_256(entry, arg, 512), USB_CRC_TABLE_256(entry, arg, 768), \
+	USB_CRC_TABLE_256(entry, arg, 1024), USB_CRC_TABLE_256(entry, arg, 1280), \
+	USB_CRC_TABLE_256(entry, arg, 1536), USB_CRC_TABLE_256(entry, arg, 1792)
+
+#define USB_CRC16_ENTRY(slice, index) \
+	usb_crc16_slice<(index), slice>::value
+
+#define USB_CRC16_SLICE(slice) \
+	{ USB_CRC_TABLE_256(USB_CRC16_ENTRY, slice, 0) }
+
+#define USB_CRC5_ENTRY(bitCount, index) \
+	usb_crc5_entry<(index), bitCount>::value
+
+// The high bits of the 19 bits, without the CRC-5 of zero counted by the low bits
+#define USB_CRC5_HIGH_ENTRY(bitCount, index) \
+	(usb_crc5_entry<((index) << 11), bitCount>::value ^ usb_crc5_of<0, bitCount>::value)
+
+const usb_crc16 (*UsbCRC::GetUsbCRC16Tables())[256]
+{
+	static const usb_crc16 tables[8][256] =
+	{
+		USB_CRC16_SLICE(0), USB_CRC16_SLICE(1), USB_CRC16_SLICE(2), USB_CRC16_SLICE(3),
+		USB_CRC16_SLICE(4), USB_CRC16_SLICE(5), USB_CRC16_SLICE(6), USB_CRC16_SLICE(7),
+	};
+
+	return tables;
+}
+
+const usb_crc5* UsbCRC::GetUsbCRC5Table11()
+{
+	static const usb_crc5 table[2048] = { USB_CRC_TABLE_2048(USB_CRC5_ENTRY, 11) };
+	return table;
+}
+
+const usb_crc5* UsbCRC::GetUsbCRC5Table19Low()
+{
+	static const usb_crc5 table[2048] = { USB_CRC_TABLE_2048(USB_CRC5_ENTRY, 19) };
+	return table;
+}
+
+const usb_crc5* UsbCRC::GetUsbCRC5Table19High()
+{
+	static const usb_crc5 table[256] = { USB_CRC_TABLE_256(USB_CRC5_HIGH_ENTRY, 19, 0) };
+	return table;
+}
+
+#undef USB_CRC5_HIGH_ENTRY
+#undef USB_CRC5_ENTRY
+#undef USB_CRC16_SLICE
+#undef USB_CRC16_ENTRY
+#undef USB_CRC_TABLE_2048
+#undef USB_CRC_TABLE_256
+#undef USB_CRC_TABLE_64
+#undef USB_CRC_TABLE_16
+#undef USB_CRC_TABLE_4
+
+}
@@ -0,0 +1,194 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbDescriptorCache.h
+/// @brief
+///		USB Analysis SDK descriptor cache declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbDescriptorCache
+
+/// @brief
+/// 	Keeps the descriptors of the devices seen on the bus.
+/// @remarks
+/// 	The standard control transfers of the devices are snooped while they
+/// 	arrive. The GET_DESCRIPTOR requests fill the device descriptor and the
+/// 	configuration descriptors of a device, SET_ADDRESS moves the cached
+/// 	descriptors of a device to its new address, and SET_CONFIGURATION and
+/// 	SET_INTERFACE select the endpoints of the device. A reset invalidates
+/// 	the whole cache, as all the devices then return to the default address.
+///
+/// 	The devices are kept in a fixed array indexed by address, and their
+/// 	endpoints in a fixed array indexed by number and direction, so the
+/// 	transfer type and the maximum packet size of an endpoint are found in
+/// 	constant time. The endpoints are known only after the device is
+/// 	configured with a configuration whose descriptor was seen.
+///
+/// 	The cache must be placed in the chain before the sinks using it, so
+/// 	an endpoint is described before its first transaction reaches them.
+/// @seealso
+/// 	UsbControlTransferReassembler, UsbDataTransferReassembler
+/// @sample
+/// \code
+/// class DeviceTransfers : public usbdk::UsbDataTransferReassembler
+/// {
+/// public:
+///     const usbdk::UsbDescriptorCache* m_pCache;
+///
+/// protected:
+///     virtual size_t GetMaxPacketSize(usbdk::usb_device_address deviceAddress,
+///         usbdk::usb_endpoint_number endpointNumber, bool isDirectionIn) const
+///     {
+///         return m_pCache->GetMaxPacketSize(deviceAddress, endpointNumber, isDirectionIn);
+///     }
+///     ...
+/// };
+///
+/// sinkManager.AddElementSink(&descriptorCache);
+/// sinkManager.AddElementSink(&deviceTransfers);
+/// \endcode
+class UsbDescriptorCache : public UsbControlTransferReassembler
+{
+private:
+	typedef std::vector<BYTE> vector_byte;
+
+	struct device_entry
+	{
+		bool hasDeviceDescriptor;
+		device_descriptor deviceDescriptor;
+		BYTE maxPacketSize0;
+		BYTE configurationValue;
+		std::vector<vector_byte> configurations;
+		vector_byte alternateSettings;
+
+		// Indexed by endpoint number and direction, bLength is 0 if unknown
+		endpoint_descriptor endpoints[max_endpoint_count*2];
+	};
+
+	device_entry m_devices[max_device_count];
+
+public:
+	/// @brief
+	/// 	Constructs a UsbDescriptorCache object.
+	/// @seealso
+	/// 	~UsbDescriptorCache()
+	inline UsbDescriptorCache();
+
+	/// @brief
+	/// 	Destroys a UsbDescriptorCache object.
+	/// @seealso
+	/// 	UsbDescriptorCache()
+	inline virtual ~UsbDescriptorCache();
+
+public:
+	/// @brief
+	/// 	Gets the device descriptor of a device.
+	/// @param
+	/// 	deviceAddress - The address of the device.
+	/// @return
+	/// 	The device descriptor, or NULL if it is unknown.
+	inline const device_descriptor* GetDeviceDescriptor(usb_device_address deviceAddress) const;
+
+	/// @brief
+	/// 	Gets the endpoint descriptor of an endpoint.
+	/// @remarks
+	/// 	The endpoint 0 has no endpoint descriptor.
+	/// @param
+	/// 	deviceAddress - The address of the device.
+	/// @param
+	/// 	endpointNumber - The number of the endpoint.
+	/// @param
+	/// 	isDirectionIn - The direction of the endpoint.
+	/// @return
+	/// 	The endpoint descriptor, or NULL if it is unknown.
+	inline const endpoint_descriptor* GetEndpointDescriptor(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn) const;
+
+	/// @brief
+	/// 	Gets the transfer type of an endpoint.
+	/// @remarks
+	/// 	The endpoint 0 is always a control endpoint.
+	/// @param
+	/// 	deviceAddress - The address of the device.
+	/// @param
+	/// 	endpointNumber - The number of the endpoint.
+	/// @param
+	/// 	isDirectionIn - The direction of the endpoint.
+	/// @param
+	/// 	type - Receives the transfer type.
+	/// @return
+	/// 	true if the transfer type is known.
+	inline bool GetTransferType(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn, transfer_type& type) const;
+
+	/// @brief
+	/// 	Gets the maximum packet size of an endpoint.
+	/// @remarks
+	/// 	The additional transactions per microframe of the high bandwidth
+	/// 	endpoints are not included. The maximum packet size of the endpoint
+	/// 	0 is known from the first 8 bytes of the device descriptor.
+	/// @param
+	/// 	deviceAddress - The address of the device.
+	/// @param
+	/// 	endpointNumber - The number of the endpoint.
+	/// @param
+	/// 	isDirectionIn - The direction of the endpoint.
+	/// @return
+	/// 	The maximum packet size, or 0 if it is unknown.
+	inline size_t GetMaxPacketSize(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn) const;
+
+	/// @brief
+	/// 	Gets the current configuration of a device.
+	/// @param
+	/// 	deviceAddress - The address of the device.
+	/// @return
+	/// 	The bConfigurationValue of the configuration, or 0 if the device is
+	/// 	not known to be configured.
+	inline BYTE GetConfigurationValue(usb_device_address deviceAddress) const;
+
+	/// @brief
+	/// 	Discards the descriptors of all the devices.
+	inline void Invalidate();
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	The cache is invalidated. A derived class overriding this method
+	/// 	must call it.
+	inline virtual void InitializeElementSink();
+
+protected:
+	/// @brief
+	/// 	Processes a control transfer.
+	/// @remarks
+	/// 	A derived class overriding this method must call it.
+	inline virtual void ProcessControlTransfer(const UsbControlTransfer& transfer);
+
+	inline virtual void ProcessBusReset(UsbReset* pReset);
+
+private:
+	inline void ProcessGetDescriptor(device_entry& device, const UsbControlTransfer& transfer);
+	inline void ProcessSetAddress(usb_device_address deviceAddress, const UsbControlTransfer& transfer);
+	inline void ProcessSetConfiguration(device_entry& device, const UsbControlTransfer& transfer);
+	inline void ProcessSetInterface(device_entry& device, const UsbControlTransfer& transfer);
+	inline static void SelectEndpoints(device_entry& device);
+	inline static vector_byte* FindConfiguration(device_entry& device, BYTE configurationValue);
+	inline static void ClearDevice(device_entry& device);
+
+private:
+	UsbDescriptorCache(const UsbDescriptorCache&);
+	UsbDescriptorCache& operator=(const UsbDescriptorCache&);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbDescriptorCache.inl"
@@ -0,0 +1,326 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbDescriptorCache.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbDescriptorCache
+//---------------------------------------------------------------
+
+UsbDescriptorCache::UsbDescriptorCache()
+{
+	Invalidate();
+}
+
+UsbDescriptorCache::~UsbDescriptorCache()
+{
+}
+
+const device_descriptor* UsbDescriptorCache::GetDeviceDescriptor(usb_device_address deviceAddress) const
+{
+	if(deviceAddress > max_device_address)
+	{
+		return NULL;
+	}
+
+	const device_entry& device = m_devices[deviceAddress];
+	return device.hasDeviceDescriptor ? &device.deviceDescriptor : NULL;
+}
+
+const endpoint_descriptor* UsbDescriptorCache::GetEndpointDescriptor(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn) const
+{
+	if((deviceAddress > max_device_address) || (endpointNumber > max_endpoint_number))
+	{
+		return NULL;
+	}
+
+	const endpoint_descriptor& endpoint = m_devices[deviceAddress].endpoints[(endpointNumber << 1) | (isDirectionIn ? 1 : 0)];
+	return (endpoint.bLength != 0) ? &endpoint : NULL;
+}
+
+bool UsbDescriptorCache::GetTransferType(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn, transfer_type& type) const
+{
+	if(endpointNumber == 0)
+	{
+		type = transferControl;
+		return true;
+	}
+
+	const endpoint_descriptor* pEndpoint = GetEndpointDescriptor(deviceAddress, endpointNumber, isDirectionIn);
+
+	if(pEndpoint == NULL)
+	{
+		return false;
+	}
+
+	type = (transfer_type) (pEndpoint->bmAttributes & transferMask);
+	return true;
+}
+
+size_t UsbDescriptorCache::GetMaxPacketSize(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn) const
+{
+	if(endpointNumber == 0)
+	{
+		return (deviceAddress <= max_device_address) ? m_devices[deviceAddress].maxPacketSize0 : 0;
+	}
+
+	const endpoint_descriptor* pEndpoint = GetEndpointDescriptor(deviceAddress, endpointNumber, isDirectionIn);
+
+	// The bits 11 and 12 are the additional transactions per microframe
+	return (pEndpoint != NULL) ? (pEndpoint->wMaxPacketSize & 0x07FF) : 0;
+}
+
+BYTE UsbDescriptorCache::GetConfigurationValue(usb_device_address deviceAddress) const
+{
+	return (deviceAddress <= max_device_address) ? m_devices[deviceAddress].configurationValue : 0;
+}
+
+void UsbDescriptorCache::Invalidate()
+{
+	for(size_t i=0; i<max_device_count; ++i)
+	{
+		ClearDevice(m_devices[i]);
+	}
+}
+
+void UsbDescriptorCache::InitializeElementSink()
+{
+	UsbControlTransferReassembler::InitializeElementSink();
+	Invalidate();
+}
+
+void UsbDescriptorCache::ProcessControlTransfer(const UsbControlTransfer& transfer)
+{
+	const setup_request& request = transfer.GetRequest();
+	const usb_device_address deviceAddress = transfer.GetDeviceAddress();
+
+	if((transfer.GetStatus() != transferStatusCompleted) ||
+		((request.bmRequestType & typeMask) != typeStandard) ||
+		(deviceAddress > max_device_address))
+	{
+		return;
+	}
+
+	device_entry& device = m_devices[deviceAddress];
+	const BYTE recipient = request.bmRequestType & recipientMask;
+
+	switch(request.bRequest)
+	{
+	case requestGetDescriptor:
+		if((recipient == recipientDevice) && transfer.IsDirectionIn())
+		{
+			ProcessGetDescriptor(device, transfer);
+		}
+		break;
+
+	case requestSetAddress:
+		if(recipient == recipientDevice)
+		{
+			ProcessSetAddress(deviceAddress, transfer);
+		}
+		break;
+
+	case requestSetConfiguration:
+		if(recipient == recipientDevice)
+		{
+			ProcessSetConfiguration(device, transfer);
+		}
+		break;
+
+	case requestSetInterface:
+		if(recipient == recipientInterface)
+		{
+			ProcessSetInterface(device, transfer);
+		}
+		break;
+	}
+}
+
+void UsbDescriptorCache::ProcessBusReset(UsbReset*)
+{
+	Invalidate();
+}
+
+void UsbDescriptorCache::ProcessGetDescriptor(device_entry& device, const UsbControlTransfer& transfer)
+{
+	const vector_usbdata data = transfer.GetData();
+	const BYTE descriptorType = (BYTE) (transfer.GetRequest().wValue >> 8);
+
+	if(descriptorType == deviceDescriptorType)
+	{
+		// The hosts first read the 8 bytes holding bMaxPacketSize0
+		if(data.size() >= 8)
+		{
+			device.maxPacketSize0 = data[7];
+		}
+
+		if(data.size() >= deviceDescriptorSize)
+		{
+			memcpy(&device.deviceDescriptor, data.begin(), sizeof(device.deviceDescriptor));
+			device.hasDeviceDescriptor = true;
+		}
+	}
+	else if(descriptorType == configurationDescriptorType)
+	{
+		if(data.size() < configurationDescriptorSize)
+		{
+			return;
+		}
+
+		const configuration_descriptor* pConfiguration = reinterpret_cast<const configuration_descriptor*>(data.begin());
+
+		// The hosts first read the configuration descriptor alone, the
+		// interfaces and endpoints are known only from a complete read
+		if(data.size() < pConfiguration->wTotalLength)
+		{
+			return;
+		}
+
+		vector_byte* pStored = FindConfiguration(device, pConfiguration->bConfigurationValue);
+
+		if(pStored == NULL)
+		{
+			device.configurations.push_back(vector_byte());
+			pStored = &device.configurations.back();
+		}
+
+		pStored->assign(data.begin(), data.begin() + pConfiguration->wTotalLength);
+
+		if(pConfiguration->bConfigurationValue == device.configurationValue)
+		{
+			SelectEndpoints(device);
+		}
+	}
+}
+
+void UsbDescriptorCache::ProcessSetAddress(usb_device_address deviceAddress, const UsbControlTransfer& transfer)
+{
+	const usb_device_address newAddress = (usb_device_address) (transfer.GetRequest().wValue & max_device_address);
+
+	if(newAddress == deviceAddress)
+	{
+		return;
+	}
+
+	// The descriptors read at the default address now belong to the new address
+	m_devices[newAddress] = m_devices[deviceAddress];
+	ClearDevice(m_devices[deviceAddress]);
+}
+
+void UsbDescriptorCache::ProcessSetConfiguration(device_entry& device, const UsbControlTransfer& transfer)
+{
+	device.configurationValue = (BYTE) transfer.GetRequest().wValue;
+	device.alternateSettings.clear();
+
+	SelectEndpoints(device);
+}
+
+void UsbDescriptorCache::ProcessSetInterface(device_entry& device, const UsbControlTransfer& transfer)
+{
+	const setup_request& request = transfer.GetRequest();
+	const BYTE interfaceNumber = (BYTE) request.wIndex;
+
+	if(device.alternateSettings.size() <= interfaceNumber)
+	{
+		device.alternateSettings.resize(interfaceNumber + 1, 0);
+	}
+
+	device.alternateSettings[interfaceNumber] = (BYTE) request.wValue;
+
+	SelectEndpoints(device);
+}
+
+void UsbDescriptorCache::SelectEndpoints(device_entry& device)
+{
+	memset(device.endpoints, 0, sizeof(device.endpoints));
+
+	if(device.configurationValue == 0)
+	{
+		return;
+	}
+
+	const vector_byte* pConfiguration = FindConfiguration(device, device.configurationValue);
+
+	if(pConfiguration == NULL)
+	{
+		return;
+	}
+
+	const vector_byte& data = *pConfiguration;
+	bool isSelected = false;
+	size_t offset = 0;
+
+	// The descriptors follow each other, each starting with its length and type
+	while(offset + 2 <= data.size())
+	{
+		const BYTE length = data[offset];
+		const BYTE descriptorType = data[offset + 1];
+
+		if((length < 2) || (offset + length > data.size()))
+		{
+			break;
+		}
+
+		if((descriptorType == interfaceDescriptorType) && (length >= interfaceDescriptorSize))
+		{
+			const interface_descriptor* pInterface = reinterpret_cast<const interface_descriptor*>(&data[offset]);
+			const BYTE alternateSetting = (pInterface->bInterfaceNumber < device.alternateSettings.size()) ? device.alternateSettings[pInterface->bInterfaceNumber] : 0;
+
+			isSelected = (pInterface->bAlternateSetting == alternateSetting);
+		}
+		else if((descriptorType == endpointDescriptorType) && (length >= endpointDescriptorSize) && isSelected)
+		{
+			const endpoint_descriptor* pEndpoint = reinterpret_cast<const endpoint_descriptor*>(&data[offset]);
+			const usb_endpoint_number endpointNumber = (usb_endpoint_number) (pEndpoint->bEndpointAddress & max_endpoint_number);
+
+			if(endpointNumber != 0)
+			{
+				const bool isDirectionIn = (pEndpoint->bEndpointAddress & directionMask) != 0;
+				device.endpoints[(endpointNumber << 1) | (isDirectionIn ? 1 : 0)] = *pEndpoint;
+			}
+		}
+
+		offset += length;
+	}
+}
+
+UsbDescriptorCache::vector_byte* UsbDescriptorCache::FindConfiguration(device_entry& device, BYTE configurationValue)
+{
+	for(size_t i=0; i<device.configurations.size(); ++i)
+	{
+		const configuration_descriptor* pConfiguration = reinterpret_cast<const configuration_descriptor*>(&device.configurations[i][0]);
+
+		if(pConfiguration->bConfigurationValue == configurationValue)
+		{
+			return &device.configurations[i];
+		}
+	}
+
+	return NULL;
+}
+
+void UsbDescriptorCache::ClearDevice(device_entry& device)
+{
+	device.hasDeviceDescriptor = false;
+	memset(&device.deviceDescriptor, 0, sizeof(device.deviceDescriptor));
+	device.maxPacketSize0 = 0;
+	device.configurationValue = 0;
+	device.configurations.clear();
+	device.alternateSettings.clear();
+	memset(device.endpoints, 0, sizeof(device.endpoints));
+}
+
+}
@@ -0,0 +1,169 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbElementBudgetStorage.h
+/// @brief
+///		USB Analysis SDK memory budgeted storage declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementSinkBudgetStorage
+
+/// @brief
+/// 	Stores the USB elements into a container within a memory budget.
+/// @remarks
+/// 	The memory used by each stored element is estimated: the element
+/// 	object, its slot in the container and the raw data of its packets
+/// 	stored out of the element. The budget is approximate, the overhead
+/// 	of the heap and the memory of the user defined elements beyond their
+/// 	object size are not accounted, so the process may use more memory
+/// 	than the budget.
+///
+/// 	When the memory used by the stored elements exceeds the budget set
+/// 	by SetMaxMemorySize, elements are evicted until the memory falls
+/// 	below 7/8 of the budget, so the cost of the eviction is shared by
+/// 	many elements. The eviction candidates, by default the start-of-frames,
+/// 	the keep-alives and the NAKed transactions, are evicted first from
+/// 	the oldest. The oldest elements are then evicted if needed.
+///
+/// 	The accounting is computed again when the container is set. The
+/// 	container must not be modified by other code while it is used by
+/// 	the sink.
+/// @seealso
+/// 	UsbElementSinkStorage, ChainableUsbElementSink
+/// @sample
+/// \code
+/// usbdk::container_usb_element elements;
+///
+/// usbdk::UsbElementSinkBudgetStorage storage;
+/// storage.SetElementsContainer(&elements);
+/// storage.SetMaxMemorySize(256*1024*1024); // Keep at most 256 MB
+///
+/// sinkChainer.AddElementSink(&storage);
+/// pAnalyzer->BeginAcquisition(&sinkChainer);
+/// ...
+/// size_t peakUsage = storage.GetPeakMemorySize();
+/// \endcode
+class UsbElementSinkBudgetStorage : public ChainableUsbElementSink
+{
+private:
+	container_usb_element* m_pElements;
+	size_t m_maxMemorySize;
+	size_t m_memorySize;
+	size_t m_peakMemorySize;
+	size_t m_evictedCount;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementSinkBudgetStorage object.
+	/// @seealso
+	/// 	~UsbElementSinkBudgetStorage()
+	inline UsbElementSinkBudgetStorage();
+
+	/// @brief
+	/// 	Destroys a UsbElementSinkBudgetStorage object.
+	/// @seealso
+	/// 	UsbElementSinkBudgetStorage()
+	inline virtual ~UsbElementSinkBudgetStorage();
+
+public:
+	/// @brief
+	/// 	Sets the container that will be used to store the elements.
+	/// @remarks
+	/// 	The memory used by the elements already in the container is accounted.
+	inline void SetElementsContainer(container_usb_element* pElements);
+
+	/// @brief
+	/// 	Sets the maximum memory used by the stored elements.
+	/// @remarks
+	/// 	The elements are evicted as soon as a new element exceeds the budget.
+	/// @param
+	/// 	size - The budget in bytes, or 0 for no limit (default).
+	/// @seealso
+	/// 	GetMaxMemorySize, GetMemorySize
+	inline void SetMaxMemorySize(size_t size);
+
+	/// @brief
+	/// 	Gets the maximum memory used by the stored elements.
+	/// @seealso
+	/// 	SetMaxMemorySize
+	inline size_t GetMaxMemorySize() const;
+
+	/// @brief
+	/// 	Gets the memory currently used by the stored elements.
+	/// @seealso
+	/// 	GetPeakMemorySize, GetElementMemorySize
+	inline size_t GetMemorySize() const;
+
+	/// @brief
+	/// 	Gets the highest memory used by the stored elements.
+	/// @remarks
+	/// 	The peak is measured before the eviction of the elements.
+	/// @seealso
+	/// 	GetMemorySize, ResetPeakMemorySize
+	inline size_t GetPeakMemorySize() const;
+
+	/// @brief
+	/// 	Sets the peak memory to the current memory.
+	/// @seealso
+	/// 	GetPeakMemorySize
+	inline void ResetPeakMemorySize();
+
+	/// @brief
+	/// 	Gets the count of elements evicted since the container was set.
+	inline size_t GetEvictedCount() const;
+
+public:
+	/// @brief
+	/// 	Gets the memory used by an USB element.
+	/// @remarks
+	/// 	The element object, its slot in the container and the raw data of
+	/// 	its packets stored out of the element are accounted. The size is an
+	/// 	estimate, it does not include the overhead of the heap, and only the
+	/// 	object size is known for the user defined elements.
+	/// @param
+	/// 	pElement - The element.
+	/// @return
+	/// 	The memory used by the element in bytes.
+	inline static size_t GetElementMemorySize(const UsbElement* pElement);
+
+	/// @brief
+	/// 	Gets the memory used by the raw data of a packet out of the packet.
+	/// @param
+	/// 	packet - The packet.
+	/// @return
+	/// 	The memory used by the raw data, or 0 if it is embedded in the packet.
+	inline static size_t GetPacketMemorySize(const UsbPacket& packet);
+
+protected:
+	/// @brief
+	/// 	Determines whether an element is evicted before the other elements.
+	/// @remarks
+	/// 	The default implementation returns true for start-of-frames,
+	/// 	keep-alives, and transactions and split transactions with a NAK
+	/// 	handshake. Derived classes can override it to change the policy.
+	/// @param
+	/// 	pElement - The element.
+	inline virtual bool IsEvictionCandidate(const UsbElement* pElement) const;
+
+public:
+	inline virtual void InitializeElementSink();
+	inline virtual void OnElementArrival(UsbElement* pElement);
+	inline virtual void FinalizeElementSink();
+
+private:
+	inline void EvictElements();
+};
+
+} // End of the usbdk namespace
+
+#include "UsbElementBudgetStorage.inl"
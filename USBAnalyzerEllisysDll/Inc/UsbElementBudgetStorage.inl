@@ -0,0 +1,234 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementBudgetStorage.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementSinkBudgetStorage
+//---------------------------------------------------------------
+
+UsbElementSinkBudgetStorage::UsbElementSinkBudgetStorage() :
+	m_pElements(NULL),
+	m_maxMemorySize(0),
+	m_memorySize(0),
+	m_peakMemorySize(0),
+	m_evictedCount(0)
+{
+}
+
+UsbElementSinkBudgetStorage::~UsbElementSinkBudgetStorage()
+{
+}
+
+void UsbElementSinkBudgetStorage::SetElementsContainer(container_usb_element* pElements)
+{
+	m_pElements = pElements;
+	m_memorySize = 0;
+	m_evictedCount = 0;
+
+	if(m_pElements != NULL)
+	{
+		for(container_usb_element::const_iterator it = m_pElements->begin(); it != m_pElements->end(); ++it)
+		{
+			m_memorySize += GetElementMemorySize(*it);
+		}
+	}
+
+	m_peakMemorySize = m_memorySize;
+}
+
+void UsbElementSinkBudgetStorage::SetMaxMemorySize(size_t size)
+{
+	m_maxMemorySize = size;
+}
+
+size_t UsbElementSinkBudgetStorage::GetMaxMemorySize() const
+{
+	return m_maxMemorySize;
+}
+
+size_t UsbElementSinkBudgetStorage::GetMemorySize() const
+{
+	return m_memorySize;
+}
+
+size_t UsbElementSinkBudgetStorage::GetPeakMemorySize() const
+{
+	return m_peakMemorySize;
+}
+
+void UsbElementSinkBudgetStorage::ResetPeakMemorySize()
+{
+	m_peakMemorySize = m_memorySize;
+}
+
+size_t UsbElementSinkBudgetStorage::GetEvictedCount() const
+{
+	return m_evictedCount;
+}
+
+size_t UsbElementSinkBudgetStorage::GetElementMemorySize(const UsbElement* pElement)
+{
+	size_t size = sizeof(UsbElement*);
+
+	C_ASSERT(elementCount == 11);
+	switch(pElement->GetElementType())
+	{
+	case elementInvalidPacket:
+		size += sizeof(UsbInvalidPacket);
+		size += GetPacketMemorySize(static_cast<const UsbInvalidPacket*>(pElement)->GetPacket());
+		break;
+
+	case elementStartOfFrame:
+		size += sizeof(UsbStartOfFrame);
+		break;
+
+	case elementTransaction:
+		size += sizeof(UsbTransaction);
+		size += GetPacketMemorySize(static_cast<const UsbTransaction*>(pElement)->GetDataPacket());
+		break;
+
+	case elementSplitTransaction:
+		size += sizeof(UsbSplitTransaction);
+		size += GetPacketMemorySize(static_cast<const UsbSplitTransaction*>(pElement)->GetDataPacket());
+		break;
+
+	case elementLpmTransaction:			size += sizeof(UsbLpmTransaction);			break;
+	case elementReset:					size += sizeof(UsbReset);					break;
+	case elementSuspended:				size += sizeof(UsbSuspended);				break;
+	case elementKeepAlive:				size += sizeof(UsbKeepAlive);				break;
+	case elementPowerChange:			size += sizeof(UsbPowerChange);				break;
+	case elementHighSpeedHandshake:		size += sizeof(UsbHighSpeedHandshake);		break;
+	case elementTrigger:				size += sizeof(UsbTrigger);					break;
+
+	default:
+		size += sizeof(UsbElement);
+		break;
+	}
+
+	return size;
+}
+
+size_t UsbElementSinkBudgetStorage::GetPacketMemorySize(const UsbPacket& packet)
+{
+	const UsbPacket::TContainer& rawData = packet.GetRawData();
+
+	// The raw data is allocated on the heap when it does not fit in the container
+	if(rawData.size() <= UsbPacket::TContainer::max_embedded_size)
+	{
+		return 0;
+	}
+
+	return rawData.size();
+}
+
+bool UsbElementSinkBudgetStorage::IsEvictionCandidate(const UsbElement* pElement) const
+{
+	switch(pElement->GetElementType())
+	{
+	case elementStartOfFrame:
+	case elementKeepAlive:
+		return true;
+
+	case elementTransaction:
+		return (static_cast<const UsbTransaction*>(pElement)->GetHandshakePacket().GetPID() == pidNAK);
+
+	case elementSplitTransaction:
+		return (static_cast<const UsbSplitTransaction*>(pElement)->GetHandshakePacket().GetPID() == pidNAK);
+	}
+
+	return false;
+}
+
+void UsbElementSinkBudgetStorage::InitializeElementSink()
+{
+}
+
+void UsbElementSinkBudgetStorage::OnElementArrival(UsbElement* pElement)
+{
+	if(m_pElements != NULL)
+	{
+		pElement->AddRef();
+		m_pElements->push_back(pElement);
+
+		m_memorySize += GetElementMemorySize(pElement);
+
+		if(m_memorySize > m_peakMemorySize)
+		{
+			m_peakMemorySize = m_memorySize;
+		}
+
+		if((m_maxMemorySize != 0) && (m_memorySize > m_maxMemorySize))
+		{
+			EvictElements();
+		}
+	}
+
+	SendToNextSink(pElement);
+}
+
+void UsbElementSinkBudgetStorage::FinalizeElementSink()
+{
+}
+
+void UsbElementSinkBudgetStorage::EvictElements()
+{
+	container_usb_element& elements = *m_pElements;
+	const size_t targetMemorySize = m_maxMemorySize - m_maxMemorySize/8;
+
+	// Evict the candidates from the oldest, keeping the order of the other elements
+	const size_t count = elements.size();
+	size_t keptCount = 0;
+
+	for(size_t i=0; i<count; ++i)
+	{
+		UsbElement* pElement = elements[i];
+
+		if((m_memorySize > targetMemorySize) && IsEvictionCandidate(pElement))
+		{
+			size_t size = GetElementMemorySize(pElement);
+			m_memorySize -= (size < m_memorySize) ? size : m_memorySize;
+			++m_evictedCount;
+
+			pElement->Release();
+			continue;
+		}
+
+		if(keptCount != i)
+		{
+			elements[keptCount] = pElement;
+		}
+
+		++keptCount;
+	}
+
+	elements.resize(keptCount);
+
+	// Evict the oldest elements
+	while((m_memorySize > targetMemorySize) && !elements.empty())
+	{
+		UsbElement* pElement = elements.front();
+		elements.pop_front();
+
+		size_t size = GetElementMemorySize(pElement);
+		m_memorySize -= (size < m_memorySize) ? size : m_memorySize;
+		++m_evictedCount;
+
+		pElement->Release();
+	}
+}
+
+}
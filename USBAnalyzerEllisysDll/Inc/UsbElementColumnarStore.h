@@ -0,0 +1,307 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbElementColumnarStore.h
+/// @brief
+///		USB Analysis SDK columnar element store declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementColumnarStore
+
+/// @brief
+/// 	Stores USB elements as parallel arrays of fields.
+/// @remarks
+/// 	Each stored element is a row of the store. The most used fields of the
+/// 	elements (time, type, device address, endpoint number, PIDs, errors and
+/// 	payload) are kept in separate contiguous arrays, so filters and statistics
+/// 	can scan a single field of a long capture without touching the elements.
+///
+/// 	The raw packets and the other fields of the elements are serialized
+/// 	in a shared byte arena. They are used to materialize the elements
+/// 	back to UsbElement objects when needed by existing code.
+///
+/// 	Elements of user defined types only have their time and type stored
+/// 	and cannot be materialized.
+/// @seealso
+/// 	UsbElementSinkColumnarStorage, container_usb_element
+class UsbElementColumnarStore
+{
+private:
+	std::vector<usb_time> m_times;
+	std::vector<WORD> m_types;
+	std::vector<usb_device_address> m_deviceAddresses;
+	std::vector<usb_endpoint_number> m_endpointNumbers;
+	std::vector<usb_pid> m_pids;
+	std::vector<usb_pid> m_handshakePids;
+	std::vector<WORD> m_errors;
+	std::vector<size_t> m_payloadOffsets;
+	std::vector<size_t> m_payloadSizes;
+	std::vector<size_t> m_recordOffsets;
+	std::vector<BYTE> m_arena;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementColumnarStore object.
+	/// @seealso
+	/// 	~UsbElementColumnarStore()
+	inline UsbElementColumnarStore();
+
+	/// @brief
+	/// 	Destroys a UsbElementColumnarStore object.
+	/// @seealso
+	/// 	UsbElementColumnarStore()
+	inline ~UsbElementColumnarStore();
+
+public:
+	/// @brief
+	/// 	Appends an USB element to the store.
+	/// @remarks
+	/// 	The element is copied into the store, no reference is kept on it.
+	/// @param
+	/// 	pElement - The element to append.
+	inline void Append(const UsbElement* pElement);
+
+	/// @brief
+	/// 	Removes all the elements of the store.
+	inline void Clear();
+
+	/// @brief
+	/// 	Reserves memory for several elements.
+	/// @param
+	/// 	elementCount - The count of elements to reserve.
+	/// @param
+	/// 	arenaSize - The size of the byte arena to reserve.
+	inline void Reserve(size_t elementCount, size_t arenaSize);
+
+	/// @brief
+	/// 	Gets the count of elements in the store.
+	inline size_t GetCount() const;
+
+	/// @brief
+	/// 	Determines whether the store is empty.
+	inline bool IsEmpty() const;
+
+	/// @brief
+	/// 	Gets the size in bytes of the shared byte arena.
+	inline size_t GetArenaSize() const;
+
+public:
+	/// @brief
+	/// 	Gets the time column.
+	/// @remarks
+	/// 	The column contains GetCount() values.
+	/// 	The pointer is invalidated by the next call to Append.
+	inline const usb_time* GetTimes() const;
+
+	/// @brief
+	/// 	Gets the element type column.
+	/// @remarks
+	/// 	The values are usb_element_type values.
+	/// 	The pointer is invalidated by the next call to Append.
+	inline const WORD* GetTypes() const;
+
+	/// @brief
+	/// 	Gets the device address column.
+	/// @remarks
+	/// 	The value is unknown_device_address for the elements without device address.
+	/// 	The token device address is stored for split transactions.
+	/// 	The pointer is invalidated by the next call to Append.
+	inline const usb_device_address* GetDeviceAddresses() const;
+
+	/// @brief
+	/// 	Gets the endpoint number column.
+	/// @remarks
+	/// 	The value is unknown_endpoint_number for the elements without endpoint number.
+	/// 	The token endpoint number is stored for split transactions.
+	/// 	The pointer is invalidated by the next call to Append.
+	inline const usb_endpoint_number* GetEndpointNumbers() const;
+
+	/// @brief
+	/// 	Gets the PID column.
+	/// @remarks
+	/// 	The value is the PID of the token packet for transactions and
+	/// 	pidSOF for start-of-frames. It is pidUnknown for the other elements.
+	/// 	The pointer is invalidated by the next call to Append.
+	inline const usb_pid* GetPIDs() const;
+
+	/// @brief
+	/// 	Gets the handshake PID column.
+	/// @remarks
+	/// 	The value is the PID of the handshake packet for transactions.
+	/// 	It is pidUnknown for the other elements or if no handshake is available.
+	/// 	The pointer is invalidated by the next call to Append.
+	inline const usb_pid* GetHandshakePIDs() const;
+
+	/// @brief
+	/// 	Gets the error bits column.
+	/// @remarks
+	/// 	The value is the result of the GetErrors method of the element,
+	/// 	its meaning depends on the element type.
+	/// 	The pointer is invalidated by the next call to Append.
+	inline const WORD* GetErrors() const;
+
+public:
+	/// @brief
+	/// 	Gets the time of an element.
+	inline usb_time GetTime(size_t index) const;
+
+	/// @brief
+	/// 	Gets the type of an element.
+	inline usb_element_type GetElementType(size_t index) const;
+
+	/// @brief
+	/// 	Gets the device address of an element.
+	inline usb_device_address GetDeviceAddress(size_t index) const;
+
+	/// @brief
+	/// 	Gets the endpoint number of an element.
+	inline usb_endpoint_number GetEndpointNumber(size_t index) const;
+
+	/// @brief
+	/// 	Gets the token PID of an element.
+	inline usb_pid GetPID(size_t index) const;
+
+	/// @brief
+	/// 	Gets the handshake PID of an element.
+	inline usb_pid GetHandshakePID(size_t index) const;
+
+	/// @brief
+	/// 	Gets the error bits of an element.
+	inline WORD GetErrors(size_t index) const;
+
+	/// @brief
+	/// 	Gets the payload of the data packet of an element.
+	/// @remarks
+	/// 	The returned data references the byte arena of the store
+	/// 	and is invalidated by the next call to Append.
+	inline vector_usbdata GetData(size_t index) const;
+
+public:
+	/// @brief
+	/// 	Finds the next transaction of an endpoint.
+	/// @param
+	/// 	first - The index of the first element to examine.
+	/// @param
+	/// 	deviceAddress - The device address of the transaction.
+	/// @param
+	/// 	endpointNumber - The endpoint number of the transaction.
+	/// @return
+	/// 	The index of the transaction if found, otherwise GetCount().
+	inline size_t FindNext(size_t first, usb_device_address deviceAddress, usb_endpoint_number endpointNumber) const;
+
+	/// @brief
+	/// 	Selects the elements of an endpoint.
+	/// @param
+	/// 	deviceAddress - The device address of the elements.
+	/// @param
+	/// 	endpointNumber - The endpoint number of the elements.
+	/// @param
+	/// 	indexes - Receives the indexes of the selected elements.
+	inline void Select(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, std::vector<size_t>& indexes) const;
+
+	/// @brief
+	/// 	Counts the elements of a type.
+	inline size_t CountElements(usb_element_type type) const;
+
+public:
+	/// @brief
+	/// 	Creates an USB element from the content of the store.
+	/// @remarks
+	/// 	The element is created by the current element factory
+	/// 	and returned with a reference count of 1.
+	/// @param
+	/// 	index - The index of the element to materialize.
+	/// @return
+	/// 	The new element, or NULL if the element type cannot be materialized.
+	/// @seealso
+	/// 	MaterializeElements, CreateElementInstance
+	inline UsbElement* MaterializeElement(size_t index) const;
+
+	/// @brief
+	/// 	Creates several USB elements from the content of the store.
+	/// @remarks
+	/// 	Each element is appended to the container with a reference count of 1.
+	/// 	The elements that cannot be materialized are skipped.
+	/// @param
+	/// 	first - The index of the first element to materialize.
+	/// @param
+	/// 	last - The index following the last element to materialize.
+	/// @param
+	/// 	elements - The container receiving the elements.
+	/// @seealso
+	/// 	MaterializeElement
+	inline void MaterializeElements(size_t first, size_t last, container_usb_element& elements) const;
+
+private:
+	template<class T>
+	void AppendValue(const T& value);
+
+	template<class T>
+	T ReadValue(size_t& offset) const;
+
+	inline void AppendPacket(const UsbPacket& packet);
+	inline void AppendDataPacket(const UsbPacketData& packet);
+	inline bool ReadPacket(size_t& offset, const BYTE*& pRawData, size_t& rawDataSize, usb_time& time, usb_speed& speed) const;
+
+	template<class TPacket>
+	TPacket ReadSpecializedPacket(size_t& offset) const;
+
+	inline void AppendRow(const UsbElement* pElement, usb_device_address deviceAddress, usb_endpoint_number endpointNumber, usb_pid pid, usb_pid handshakePid, WORD errors);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementSinkColumnarStorage
+
+/// @brief
+/// 	Stores the USB elements into a columnar store for further analysis.
+/// @remarks
+/// 	The elements are appended to a UsbElementColumnarStore. They are also
+/// 	given to UsbElementSinkStorage, which keeps them in the elements
+/// 	container if one was set with SetElementsContainer, and sends them
+/// 	to the next sink.
+/// @seealso
+/// 	UsbElementColumnarStore, UsbElementSinkStorage
+class UsbElementSinkColumnarStorage : public UsbElementSinkStorage
+{
+private:
+	UsbElementColumnarStore* m_pStore;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementSinkColumnarStorage object.
+	/// @seealso
+	/// 	~UsbElementSinkColumnarStorage()
+	inline UsbElementSinkColumnarStorage();
+
+	/// @brief
+	/// 	Destroys a UsbElementSinkColumnarStorage object.
+	/// @seealso
+	/// 	UsbElementSinkColumnarStorage()
+	inline virtual ~UsbElementSinkColumnarStorage();
+
+public:
+	/// @brief
+	/// 	Sets the columnar store that will be used to store the elements.
+	inline void SetColumnarStore(UsbElementColumnarStore* pStore);
+
+	/// @brief
+	/// 	Gets the columnar store used to store the elements.
+	inline UsbElementColumnarStore* GetColumnarStore();
+
+public:
+	inline virtual void OnElementArrival(UsbElement* pElement);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbElementColumnarStore.inl"
@@ -0,0 +1,533 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementColumnarStore.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementColumnarStore
+//---------------------------------------------------------------
+
+UsbElementColumnarStore::UsbElementColumnarStore()
+{
+}
+
+UsbElementColumnarStore::~UsbElementColumnarStore()
+{
+}
+
+void UsbElementColumnarStore::Append(const UsbElement* pElement)
+{
+	ASSERT(pElement != NULL);
+
+	C_ASSERT(elementCount == 11);
+	switch(pElement->GetElementType())
+	{
+	case elementInvalidPacket:
+		{
+			const UsbInvalidPacket* pInvalidPacket = (const UsbInvalidPacket*) pElement;
+			AppendRow(pElement, unknown_device_address, unknown_endpoint_number, pidUnknown, pidUnknown, pInvalidPacket->GetPacket().GetErrors());
+			AppendPacket(pInvalidPacket->GetPacket());
+		}
+		break;
+
+	case elementStartOfFrame:
+		{
+			const UsbStartOfFrame* pStartOfFrame = (const UsbStartOfFrame*) pElement;
+			AppendRow(pElement, unknown_device_address, unknown_endpoint_number, pidSOF, pidUnknown, pStartOfFrame->GetErrors());
+			AppendPacket(pStartOfFrame->GetPacket());
+			AppendValue(pStartOfFrame->GetMicroFrameNumber());
+			AppendValue((BYTE) (pStartOfFrame->GetNonConsecutive() ? 1 : 0));
+		}
+		break;
+
+	case elementTransaction:
+		{
+			const UsbTransaction* pTransaction = (const UsbTransaction*) pElement;
+			AppendRow(pElement, pTransaction->GetDeviceAddress(), pTransaction->GetEndpointNumber(),
+				pTransaction->GetTokenPacket().GetPID(), pTransaction->GetHandshakePacket().GetPID(), pTransaction->GetErrors());
+			AppendPacket(pTransaction->GetTokenPacket());
+			AppendDataPacket(pTransaction->GetDataPacket());
+			AppendPacket(pTransaction->GetHandshakePacket());
+		}
+		break;
+
+	case elementSplitTransaction:
+		{
+			const UsbSplitTransaction* pSplitTransaction = (const UsbSplitTransaction*) pElement;
+			AppendRow(pElement, pSplitTransaction->GetTokenDeviceAddress(), pSplitTransaction->GetTokenEndpointNumber(),
+				pSplitTransaction->GetTokenPacket().GetPID(), pSplitTransaction->GetHandshakePacket().GetPID(), pSplitTransaction->GetErrors());
+			AppendPacket(pSplitTransaction->GetSplitPacket());
+			AppendPacket(pSplitTransaction->GetTokenPacket());
+			AppendDataPacket(pSplitTransaction->GetDataPacket());
+			AppendPacket(pSplitTransaction->GetHandshakePacket());
+		}
+		break;
+
+	case elementLpmTransaction:
+		{
+			const UsbLpmTransaction* pLpmTransaction = (const UsbLpmTransaction*) pElement;
+			AppendRow(pElement, pLpmTransaction->GetDeviceAddress(), pLpmTransaction->GetEndpointNumber(),
+				pLpmTransaction->GetTokenPacket().GetPID(), pLpmTransaction->GetHandshakePacket().GetPID(), pLpmTransaction->GetErrors());
+			AppendPacket(pLpmTransaction->GetTokenPacket());
+			AppendPacket(pLpmTransaction->GetExtTokenPacket());
+			AppendPacket(pLpmTransaction->GetHandshakePacket());
+		}
+		break;
+
+	case elementReset:
+		AppendRow(pElement, unknown_device_address, unknown_endpoint_number, pidUnknown, pidUnknown, 0);
+		AppendValue(((const UsbReset*) pElement)->GetDuration());
+		break;
+
+	case elementSuspended:
+		AppendRow(pElement, unknown_device_address, unknown_endpoint_number, pidUnknown, pidUnknown, 0);
+		AppendValue(((const UsbSuspended*) pElement)->GetDuration());
+		break;
+
+	case elementPowerChange:
+		AppendRow(pElement, unknown_device_address, unknown_endpoint_number, pidUnknown, pidUnknown, 0);
+		AppendValue(((const UsbPowerChange*) pElement)->GetPowerChange());
+		break;
+
+	case elementHighSpeedHandshake:
+		AppendRow(pElement, unknown_device_address, unknown_endpoint_number, pidUnknown, pidUnknown, 0);
+		AppendValue(((const UsbHighSpeedHandshake*) pElement)->GetStatus());
+		break;
+
+	default:
+		// Keep alive, trigger and user defined elements only have a time
+		AppendRow(pElement, unknown_device_address, unknown_endpoint_number, pidUnknown, pidUnknown, 0);
+		break;
+	}
+}
+
+void UsbElementColumnarStore::Clear()
+{
+	m_times.clear();
+	m_types.clear();
+	m_deviceAddresses.clear();
+	m_endpointNumbers.clear();
+	m_pids.clear();
+	m_handshakePids.clear();
+	m_errors.clear();
+	m_payloadOffsets.clear();
+	m_payloadSizes.clear();
+	m_recordOffsets.clear();
+	m_arena.clear();
+}
+
+void UsbElementColumnarStore::Reserve(size_t elementCount, size_t arenaSize)
+{
+	m_times.reserve(elementCount);
+	m_types.reserve(elementCount);
+	m_deviceAddresses.reserve(elementCount);
+	m_endpointNumbers.reserve(elementCount);
+	m_pids.reserve(elementCount);
+	m_handshakePids.reserve(elementCount);
+	m_errors.reserve(elementCount);
+	m_payloadOffsets.reserve(elementCount);
+	m_payloadSizes.reserve(elementCount);
+	m_recordOffsets.reserve(elementCount);
+	m_arena.reserve(arenaSize);
+}
+
+size_t UsbElementColumnarStore::GetCount() const
+{
+	return m_times.size();
+}
+
+bool UsbElementColumnarStore::IsEmpty() const
+{
+	return m_times.empty();
+}
+
+size_t UsbElementColumnarStore::GetArenaSize() const
+{
+	return m_arena.size();
+}
+
+const usb_time* UsbElementColumnarStore::GetTimes() const
+{
+	return m_times.empty() ? NULL : &m_times[0];
+}
+
+const WORD* UsbElementColumnarStore::GetTypes() const
+{
+	return m_types.empty() ? NULL : &m_types[0];
+}
+
+const usb_device_address* UsbElementColumnarStore::GetDeviceAddresses() const
+{
+	return m_deviceAddresses.empty() ? NULL : &m_deviceAddresses[0];
+}
+
+const usb_endpoint_number* UsbElementColumnarStore::GetEndpointNumbers() const
+{
+	return m_endpointNumbers.empty() ? NULL : &m_endpointNumbers[0];
+}
+
+const usb_pid* UsbElementColumnarStore::GetPIDs() const
+{
+	return m_pids.empty() ? NULL : &m_pids[0];
+}
+
+const usb_pid* UsbElementColumnarStore::GetHandshakePIDs() const
+{
+	return m_handshakePids.empty() ? NULL : &m_handshakePids[0];
+}
+
+const WORD* UsbElementColumnarStore::GetErrors() const
+{
+	return m_errors.empty() ? NULL : &m_errors[0];
+}
+
+usb_time UsbElementColumnarStore::GetTime(size_t index) const
+{
+	return m_times[index];
+}
+
+usb_element_type UsbElementColumnarStore::GetElementType(size_t index) const
+{
+	return (usb_element_type) m_types[index];
+}
+
+usb_device_address UsbElementColumnarStore::GetDeviceAddress(size_t index) const
+{
+	return m_deviceAddresses[index];
+}
+
+usb_endpoint_number UsbElementColumnarStore::GetEndpointNumber(size_t index) const
+{
+	return m_endpointNumbers[index];
+}
+
+usb_pid UsbElementColumnarStore::GetPID(size_t index) const
+{
+	return m_pids[index];
+}
+
+usb_pid UsbElementColumnarStore::GetHandshakePID(size_t index) const
+{
+	return m_handshakePids[index];
+}
+
+WORD UsbElementColumnarStore::GetErrors(size_t index) const
+{
+	return m_errors[index];
+}
+
+vector_usbdata UsbElementColumnarStore::GetData(size_t index) const
+{
+	if(m_payloadSizes[index] == 0)
+	{
+		return vector_usbdata();
+	}
+
+	return vector_usbdata(m_payloadSizes[index], &m_arena[m_payloadOffsets[index]]);
+}
+
+size_t UsbElementColumnarStore::FindNext(size_t first, usb_device_address deviceAddress, usb_endpoint_number endpointNumber) const
+{
+	const size_t count = GetCount();
+
+	for(size_t i=first; i<count; ++i)
+	{
+		if((m_deviceAddresses[i] == deviceAddress) && (m_endpointNumbers[i] == endpointNumber) && (m_types[i] == elementTransaction))
+		{
+			return i;
+		}
+	}
+
+	return count;
+}
+
+void UsbElementColumnarStore::Select(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, std::vector<size_t>& indexes) const
+{
+	const size_t count = GetCount();
+
+	for(size_t i=0; i<count; ++i)
+	{
+		if((m_deviceAddresses[i] == deviceAddress) && (m_endpointNumbers[i] == endpointNumber))
+		{
+			indexes.push_back(i);
+		}
+	}
+}
+
+size_t UsbElementColumnarStore::CountElements(usb_element_type type) const
+{
+	const size_t count = GetCount();
+	size_t result = 0;
+
+	for(size_t i=0; i<count; ++i)
+	{
+		result += (m_types[i] == type) ? 1 : 0;
+	}
+
+	return result;
+}
+
+UsbElement* UsbElementColumnarStore::MaterializeElement(size_t index) const
+{
+	size_t offset = m_recordOffsets[index];
+	UsbElement* pElement = NULL;
+
+	C_ASSERT(elementCount == 11);
+	switch(m_types[index])
+	{
+	case elementInvalidPacket:
+		{
+			UsbInvalidPacket* pInvalidPacket = CreateElementInstance<UsbInvalidPacket>();
+			pInvalidPacket->SetPacket(ReadSpecializedPacket<UsbPacketInvalid>(offset));
+			pElement = pInvalidPacket;
+		}
+		break;
+
+	case elementStartOfFrame:
+		{
+			UsbStartOfFrame* pStartOfFrame = CreateElementInstance<UsbStartOfFrame>();
+			pStartOfFrame->SetPacket(ReadSpecializedPacket<UsbPacketStartOfFrame>(offset));
+			pStartOfFrame->SetMicroFrameNumber(ReadValue<usb_microframe_number>(offset));
+			pStartOfFrame->SetNonConsecutive(ReadValue<BYTE>(offset) != 0);
+			pElement = pStartOfFrame;
+		}
+		break;
+
+	case elementTransaction:
+		{
+			UsbTransaction* pTransaction = CreateElementInstance<UsbTransaction>();
+			pTransaction->SetTokenPacket(ReadSpecializedPacket<UsbPacketToken>(offset));
+			pTransaction->SetDataPacket(ReadSpecializedPacket<UsbPacketData>(offset));
+			pTransaction->SetHandshakePacket(ReadSpecializedPacket<UsbPacketHandshake>(offset));
+			pElement = pTransaction;
+		}
+		break;
+
+	case elementSplitTransaction:
+		{
+			UsbSplitTransaction* pSplitTransaction = CreateElementInstance<UsbSplitTransaction>();
+			pSplitTransaction->SetSplitPacket(ReadSpecializedPacket<UsbPacketSplit>(offset));
+			pSplitTransaction->SetTokenPacket(ReadSpecializedPacket<UsbPacketToken>(offset));
+			pSplitTransaction->SetDataPacket(ReadSpecializedPacket<UsbPacketData>(offset));
+			pSplitTransaction->SetHandshakePacket(ReadSpecializedPacket<UsbPacketHandshake>(offset));
+			pElement = pSplitTransaction;
+		}
+		break;
+
+	case elementLpmTransaction:
+		{
+			UsbLpmTransaction* pLpmTransaction = CreateElementInstance<UsbLpmTransaction>();
+			pLpmTransaction->SetTokenPacket(ReadSpecializedPacket<UsbPacketToken>(offset));
+			pLpmTransaction->SetExtTokenPacket(ReadSpecializedPacket<UsbPacketExtToken>(offset));
+			pLpmTransaction->SetHandshakePacket(ReadSpecializedPacket<UsbPacketHandshake>(offset));
+			pElement = pLpmTransaction;
+		}
+		break;
+
+	case elementReset:
+		{
+			UsbReset* pReset = CreateElementInstance<UsbReset>();
+			pReset->SetTime(m_times[index]);
+			pReset->SetDuration(ReadValue<usb_time>(offset));
+			pElement = pReset;
+		}
+		break;
+
+	case elementSuspended:
+		{
+			UsbSuspended* pSuspended = CreateElementInstance<UsbSuspended>();
+			pSuspended->SetTime(m_times[index]);
+			pSuspended->SetDuration(ReadValue<usb_time>(offset));
+			pElement = pSuspended;
+		}
+		break;
+
+	case elementKeepAlive:
+		{
+			UsbKeepAlive* pKeepAlive = CreateElementInstance<UsbKeepAlive>();
+			pKeepAlive->SetTime(m_times[index]);
+			pElement = pKeepAlive;
+		}
+		break;
+
+	case elementPowerChange:
+		{
+			UsbPowerChange* pPowerChange = CreateElementInstance<UsbPowerChange>();
+			pPowerChange->SetTime(m_times[index]);
+			pPowerChange->SetPowerChange(ReadValue<usb_power_change>(offset));
+			pElement = pPowerChange;
+		}
+		break;
+
+	case elementHighSpeedHandshake:
+		{
+			UsbHighSpeedHandshake* pHighSpeedHandshake = CreateElementInstance<UsbHighSpeedHandshake>();
+			pHighSpeedHandshake->SetTime(m_times[index]);
+			pHighSpeedHandshake->SetStatus(ReadValue<usb_highspeed_handshake_status>(offset));
+			pElement = pHighSpeedHandshake;
+		}
+		break;
+
+	case elementTrigger:
+		{
+			UsbTrigger* pTrigger = CreateElementInstance<UsbTrigger>();
+			pTrigger->SetTime(m_times[index]);
+			pElement = pTrigger;
+		}
+		break;
+	}
+
+	if(pElement != NULL)
+	{
+		pElement->AddRef();
+	}
+
+	return pElement;
+}
+
+void UsbElementColumnarStore::MaterializeElements(size_t first, size_t last, container_usb_element& elements) const
+{
+	for(size_t i=first; i<last; ++i)
+	{
+		UsbElement* pElement = MaterializeElement(i);
+
+		if(pElement != NULL)
+		{
+			elements.push_back(pElement);
+		}
+	}
+}
+
+template<class T>
+void UsbElementColumnarStore::AppendValue(const T& value)
+{
+	size_t offset = m_arena.size();
+	m_arena.resize(offset + sizeof(T));
+	memcpy(&m_arena[offset], &value, sizeof(T));
+}
+
+template<class T>
+T UsbElementColumnarStore::ReadValue(size_t& offset) const
+{
+	T value;
+	memcpy(&value, &m_arena[offset], sizeof(T));
+	offset += sizeof(T);
+	return value;
+}
+
+void UsbElementColumnarStore::AppendPacket(const UsbPacket& packet)
+{
+	const UsbPacket::TContainer& rawData = packet.GetRawData();
+
+	AppendValue(packet.GetTime());
+	AppendValue(packet.GetSpeed());
+	AppendValue((DWORD) rawData.size());
+
+	if(!rawData.empty())
+	{
+		m_arena.insert(m_arena.end(), rawData.begin(), rawData.end());
+	}
+}
+
+void UsbElementColumnarStore::AppendDataPacket(const UsbPacketData& packet)
+{
+	AppendPacket(packet);
+
+	const size_t rawDataSize = packet.GetRawData().size();
+
+	if(rawDataSize >= 3)
+	{
+		// The payload is between the PID and the CRC-16 of the raw data
+		m_payloadOffsets.back() = m_arena.size() - rawDataSize + 1;
+		m_payloadSizes.back() = rawDataSize - 3;
+	}
+}
+
+bool UsbElementColumnarStore::ReadPacket(size_t& offset, const BYTE*& pRawData, size_t& rawDataSize, usb_time& time, usb_speed& speed) const
+{
+	time = ReadValue<usb_time>(offset);
+	speed = ReadValue<usb_speed>(offset);
+	rawDataSize = ReadValue<DWORD>(offset);
+	pRawData = (rawDataSize != 0) ? &m_arena[offset] : NULL;
+	offset += rawDataSize;
+
+	return (rawDataSize != 0);
+}
+
+template<class TPacket>
+TPacket UsbElementColumnarStore::ReadSpecializedPacket(size_t& offset) const
+{
+	const BYTE* pRawData;
+	size_t rawDataSize;
+	usb_time time;
+	usb_speed speed;
+
+	if(!ReadPacket(offset, pRawData, rawDataSize, time, speed))
+	{
+		return TPacket();
+	}
+
+	return TPacket(pRawData, rawDataSize, time, speed);
+}
+
+void UsbElementColumnarStore::AppendRow(const UsbElement* pElement, usb_device_address deviceAddress, usb_endpoint_number endpointNumber, usb_pid pid, usb_pid handshakePid, WORD errors)
+{
+	m_times.push_back(pElement->GetTime());
+	m_types.push_back((WORD) pElement->GetElementType());
+	m_deviceAddresses.push_back(deviceAddress);
+	m_endpointNumbers.push_back(endpointNumber);
+	m_pids.push_back(pid);
+	m_handshakePids.push_back(handshakePid);
+	m_errors.push_back(errors);
+	m_payloadOffsets.push_back(0);
+	m_payloadSizes.push_back(0);
+	m_recordOffsets.push_back(m_arena.size());
+}
+
+//---------------------------------------------------------------
+// UsbElementSinkColumnarStorage
+//---------------------------------------------------------------
+
+UsbElementSinkColumnarStorage::UsbElementSinkColumnarStorage() :
+	m_pStore(NULL)
+{
+}
+
+UsbElementSinkColumnarStorage::~UsbElementSinkColumnarStorage()
+{
+}
+
+void UsbElementSinkColumnarStorage::SetColumnarStore(UsbElementColumnarStore* pStore)
+{
+	m_pStore = pStore;
+}
+
+UsbElementColumnarStore* UsbElementSinkColumnarStorage::GetColumnarStore()
+{
+	return m_pStore;
+}
+
+void UsbElementSinkColumnarStorage::OnElementArrival(UsbElement* pElement)
+{
+	if(m_pStore != NULL)
+	{
+		m_pStore->Append(pElement);
+	}
+
+	UsbElementSinkStorage::OnElementArrival(pElement);
+}
+
+}
@@ -0,0 +1,173 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbElementErrorsCache.h
+/// @brief
+///		USB Analysis SDK element errors cache declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementErrorsCache
+
+/// @brief
+/// 	Keeps the errors of USB elements, so they are computed only once.
+/// @remarks
+/// 	The errors of the Start-of-Frames, the transactions, the split
+/// 	transactions and the LPM transactions are computed by their GetErrors
+/// 	method, which checks the PID and the CRC of each packet again on every
+/// 	call. The cache keeps the result in a table of its own, the elements
+/// 	are not modified. The cache holds a reference to each cached element,
+/// 	so a new element cannot reuse the address of a cached one.
+///
+/// 	The errors are computed on the first query of an element, or when the
+/// 	element arrives if the cache is chained with other sinks. When the
+/// 	cache follows a UsbElementSinkAsync, the errors are computed by the
+/// 	worker thread of that sink and the later queries, like the ones of a
+/// 	user interface or a filter, find them in the table. The queries may be
+/// 	made by another thread than the one sending the elements.
+///
+/// 	A cached element must not be modified. Invalidate removes an element
+/// 	from the cache, so its errors are computed again on the next query.
+/// @seealso
+/// 	UsbStartOfFrame::GetErrors, UsbTransaction::GetErrors, UsbSplitTransaction::GetErrors, UsbLpmTransaction::GetErrors
+/// @sample
+/// \code
+/// usbdk::UsbElementErrorsCache errorsCache;
+///
+/// sinkChainer.AddElementSink(&asyncSink);
+/// sinkChainer.AddElementSink(&errorsCache);
+/// sinkChainer.AddElementSink(&storage);
+/// pAnalyzer->BeginAcquisition(&sinkChainer);
+/// ...
+/// if(!errorsCache.IsValid(elements[i]))
+/// {
+///     HighlightElement(elements[i]);
+/// }
+/// \endcode
+class UsbElementErrorsCache : public UsbElementVisitor<UsbElementErrorsCache>
+{
+	friend class UsbElementVisitor<UsbElementErrorsCache>;
+
+private:
+	typedef std::map<const UsbElement*, BYTE> map_errors;
+
+	map_errors m_errors;
+	mutable CRITICAL_SECTION m_lock;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementErrorsCache object.
+	/// @seealso
+	/// 	~UsbElementErrorsCache()
+	inline UsbElementErrorsCache();
+
+	/// @brief
+	/// 	Destroys a UsbElementErrorsCache object.
+	/// @remarks
+	/// 	The references to the cached elements are released.
+	/// @seealso
+	/// 	UsbElementErrorsCache()
+	inline virtual ~UsbElementErrorsCache();
+
+public:
+	/// @brief
+	/// 	Gets the errors of a USB Start-of-Frame.
+	/// @param
+	/// 	pStartOfFrame - The element.
+	/// @seealso
+	/// 	UsbStartOfFrame::GetErrors
+	inline usb_startofframe_errors GetErrors(const UsbStartOfFrame* pStartOfFrame);
+
+	/// @brief
+	/// 	Gets the errors of a USB transaction.
+	/// @param
+	/// 	pTransaction - The element.
+	/// @seealso
+	/// 	UsbTransaction::GetErrors
+	inline usb_transaction_errors GetErrors(const UsbTransaction* pTransaction);
+
+	/// @brief
+	/// 	Gets the errors of a USB split transaction.
+	/// @param
+	/// 	pSplitTransaction - The element.
+	/// @seealso
+	/// 	UsbSplitTransaction::GetErrors
+	inline usb_split_transaction_errors GetErrors(const UsbSplitTransaction* pSplitTransaction);
+
+	/// @brief
+	/// 	Gets the errors of a USB LPM transaction.
+	/// @param
+	/// 	pLpmTransaction - The element.
+	/// @seealso
+	/// 	UsbLpmTransaction::GetErrors
+	inline usb_lpm_transaction_errors GetErrors(const UsbLpmTransaction* pLpmTransaction);
+
+	/// @brief
+	/// 	Determines if a USB element contains no error.
+	/// @remarks
+	/// 	The Start-of-Frames, the transactions, the split transactions and
+	/// 	the LPM transactions are valid if they have no error. An invalid
+	/// 	packet element is never valid, and the other elements are always
+	/// 	valid.
+	/// @param
+	/// 	pElement - The element.
+	/// @return
+	/// 	true if the element contains no error.
+	inline bool IsValid(const UsbElement* pElement);
+
+	/// @brief
+	/// 	Removes a USB element from the cache.
+	/// @remarks
+	/// 	The reference to the element is released. Call this method before
+	/// 	modifying a cached element.
+	/// @param
+	/// 	pElement - The element.
+	inline void Invalidate(const UsbElement* pElement);
+
+	/// @brief
+	/// 	Removes all the USB elements from the cache.
+	/// @remarks
+	/// 	The references to the cached elements are released.
+	inline void Clear();
+
+	/// @brief
+	/// 	Gets the count of cached USB elements.
+	inline size_t GetCount() const;
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	The cache is cleared. A derived class overriding this method must
+	/// 	call it.
+	inline virtual void InitializeElementSink();
+
+	inline virtual void FinalizeElementSink();
+
+protected:
+	inline void ProcessStartOfFrame(UsbStartOfFrame* pStartOfFrame);
+	inline void ProcessTransaction(UsbTransaction* pTransaction);
+	inline void ProcessSplitTransaction(UsbSplitTransaction* pSplitTransaction);
+	inline void ProcessLpmTransaction(UsbLpmTransaction* pLpmTransaction);
+
+private:
+	template<class TElement>
+	inline BYTE GetCachedErrors(const TElement* pElement);
+
+private:
+	UsbElementErrorsCache(const UsbElementErrorsCache&);
+	UsbElementErrorsCache& operator=(const UsbElementErrorsCache&);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbElementErrorsCache.inl"
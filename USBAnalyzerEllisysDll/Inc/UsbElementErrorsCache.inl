@@ -0,0 +1,182 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementErrorsCache.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementErrorsCache
+//---------------------------------------------------------------
+
+UsbElementErrorsCache::UsbElementErrorsCache()
+{
+	InitializeCriticalSection(&m_lock);
+}
+
+UsbElementErrorsCache::~UsbElementErrorsCache()
+{
+	Clear();
+	DeleteCriticalSection(&m_lock);
+}
+
+usb_startofframe_errors UsbElementErrorsCache::GetErrors(const UsbStartOfFrame* pStartOfFrame)
+{
+	return GetCachedErrors(pStartOfFrame);
+}
+
+usb_transaction_errors UsbElementErrorsCache::GetErrors(const UsbTransaction* pTransaction)
+{
+	return GetCachedErrors(pTransaction);
+}
+
+usb_split_transaction_errors UsbElementErrorsCache::GetErrors(const UsbSplitTransaction* pSplitTransaction)
+{
+	return GetCachedErrors(pSplitTransaction);
+}
+
+usb_lpm_transaction_errors UsbElementErrorsCache::GetErrors(const UsbLpmTransaction* pLpmTransaction)
+{
+	return GetCachedErrors(pLpmTransaction);
+}
+
+bool UsbElementErrorsCache::IsValid(const UsbElement* pElement)
+{
+	switch(pElement->GetElementType())
+	{
+	case elementInvalidPacket:
+		return false;
+
+	case elementStartOfFrame:
+		return (GetCachedErrors(static_cast<const UsbStartOfFrame*>(pElement)) == errorStartOfFrameNothing);
+
+	case elementTransaction:
+		return (GetCachedErrors(static_cast<const UsbTransaction*>(pElement)) == errorTransactionNothing);
+
+	case elementSplitTransaction:
+		return (GetCachedErrors(static_cast<const UsbSplitTransaction*>(pElement)) == errorSplitTransactionNothing);
+
+	case elementLpmTransaction:
+		return (GetCachedErrors(static_cast<const UsbLpmTransaction*>(pElement)) == errorLpmTransactionNothing);
+	}
+
+	return true;
+}
+
+void UsbElementErrorsCache::Invalidate(const UsbElement* pElement)
+{
+	EnterCriticalSection(&m_lock);
+
+	map_errors::iterator it = m_errors.find(pElement);
+	const bool isCached = (it != m_errors.end());
+
+	if(isCached)
+	{
+		m_errors.erase(it);
+	}
+
+	LeaveCriticalSection(&m_lock);
+
+	if(isCached)
+	{
+		const_cast<UsbElement*>(pElement)->Release();
+	}
+}
+
+void UsbElementErrorsCache::Clear()
+{
+	map_errors errors;
+
+	EnterCriticalSection(&m_lock);
+	m_errors.swap(errors);
+	LeaveCriticalSection(&m_lock);
+
+	// The elements are released out of the lock, their destruction may be long
+	for(map_errors::iterator it = errors.begin(); it != errors.end(); ++it)
+	{
+		const_cast<UsbElement*>(it->first)->Release();
+	}
+}
+
+size_t UsbElementErrorsCache::GetCount() const
+{
+	EnterCriticalSection(&m_lock);
+	const size_t count = m_errors.size();
+	LeaveCriticalSection(&m_lock);
+
+	return count;
+}
+
+void UsbElementErrorsCache::InitializeElementSink()
+{
+	Clear();
+}
+
+void UsbElementErrorsCache::FinalizeElementSink()
+{
+}
+
+void UsbElementErrorsCache::ProcessStartOfFrame(UsbStartOfFrame* pStartOfFrame)
+{
+	GetCachedErrors(pStartOfFrame);
+}
+
+void UsbElementErrorsCache::ProcessTransaction(UsbTransaction* pTransaction)
+{
+	GetCachedErrors(pTransaction);
+}
+
+void UsbElementErrorsCache::ProcessSplitTransaction(UsbSplitTransaction* pSplitTransaction)
+{
+	GetCachedErrors(pSplitTransaction);
+}
+
+void UsbElementErrorsCache::ProcessLpmTransaction(UsbLpmTransaction* pLpmTransaction)
+{
+	GetCachedErrors(pLpmTransaction);
+}
+
+template<class TElement>
+BYTE UsbElementErrorsCache::GetCachedErrors(const TElement* pElement)
+{
+	EnterCriticalSection(&m_lock);
+
+	map_errors::const_iterator it = m_errors.find(pElement);
+
+	if(it != m_errors.end())
+	{
+		const BYTE errors = it->second;
+		LeaveCriticalSection(&m_lock);
+
+		return errors;
+	}
+
+	LeaveCriticalSection(&m_lock);
+
+	// The errors are computed out of the lock, the queries of other elements are not delayed
+	const BYTE errors = pElement->GetErrors();
+
+	EnterCriticalSection(&m_lock);
+
+	if(m_errors.insert(map_errors::value_type(pElement, errors)).second)
+	{
+		const_cast<TElement*>(pElement)->AddRef();
+	}
+
+	LeaveCriticalSection(&m_lock);
+
+	return errors;
+}
+
+}
@@ -23,9 +23,12 @@ namespace usbdk {
 /// @remarks
 /// 	A custom element factory can be defined with the 
 /// 	UsbElementFactoryManager::SetCurrentElementFactory method.
+///
+/// 	The factory uses the reference counting policy of the elements, 
+/// 	since the pooled elements keep a reference on their factory.
 /// @seealso
 /// 	UsbElementFactoryManager::SetCurrentElementFactory, GetElementFactoryManager
-class IUsbElementFactory : public RefCount
+class IUsbElementFactory : public RefCountT<usb_element_refcount_policy>
 {
 public:
 	/// @brief
@@ -47,6 +50,179 @@ public:
 	virtual UsbElement* CreateElement(usb_element_type type);
 };
 
+/// @brief
+/// 	Factory of pooled USB elements.
+/// @remarks
+/// 	The elements created by this factory are not returned to the heap when their 
+/// 	reference count reaches zero. They are destroyed and their storage is returned 
+/// 	to a free list dedicated to their usb_element_type. The next CreateElement call 
+/// 	for the same type reuses this storage instead of allocating from the heap.
+/// 	Elements of user defined types are created by the standard factory and are not pooled.
+/// 	
+/// 	Each pooled element holds a reference on the factory, so the factory 
+/// 	outlives all the elements it has created.
+/// 	
+/// 	The free lists are protected by a critical section, so the elements 
+/// 	can be released by another thread than the one creating them.
+/// @seealso
+/// 	IUsbElementFactory, UsbElementFactoryManager::SetCurrentElementFactory
+/// @sample
+/// \code
+/// usbdk::RefCountPtr<usbdk::UsbElementFactoryPooled> spFactory(usbdk::CreateInstance<usbdk::UsbElementFactoryPooled>());
+/// usbdk::GetElementFactoryManager()->SetCurrentElementFactory(spFactory);
+/// 
+/// pAnalyzer->BeginAcquisition(&sinkChainer);
+/// ...
+/// pAnalyzer->EndAcquisition();
+/// 
+/// size_t hits = spFactory->GetHitCount();
+/// size_t misses = spFactory->GetMissCount();
+/// \endcode
+class UsbElementFactoryPooled : public IUsbElementFactory
+{
+	template<class TElement>
+	friend class UsbPooledElement;
+
+private:
+	struct free_storage
+	{
+		free_storage* pNext;
+	};
+
+	// Stored before each pooled element, since the element is already
+	// destroyed when its storage is recycled
+	union pooled_header
+	{
+		UsbElementFactoryPooled* pFactory;
+		DWORDLONG alignment;
+	};
+
+	free_storage* m_freeLists[elementCount];
+	size_t m_freeCounts[elementCount];
+	size_t m_hitCounts[elementCount];
+	size_t m_missCounts[elementCount];
+	size_t m_maxFreeCount;
+	UsbElementFactoryStandard m_standardFactory;
+	mutable CRITICAL_SECTION m_lock;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementFactoryPooled object.
+	/// @seealso
+	/// 	~UsbElementFactoryPooled()
+	inline UsbElementFactoryPooled();
+
+	/// @brief
+	/// 	Destroys a UsbElementFactoryPooled object.
+	/// @remarks
+	/// 	The storage kept in the free lists is returned to the heap.
+	/// @seealso
+	/// 	UsbElementFactoryPooled()
+	inline virtual ~UsbElementFactoryPooled();
+
+public:
+	inline virtual UsbElement* CreateElement(usb_element_type type);
+
+public:
+	/// @brief
+	/// 	Sets the maximum count of free elements kept by each free list.
+	/// @remarks
+	/// 	The storage of an element released while its free list is full 
+	/// 	is returned to the heap. There is no limit by default.
+	/// @param
+	/// 	count - The maximum count of free elements per element type.
+	/// @seealso
+	/// 	Reserve, Trim
+	inline void SetMaxFreeCount(size_t count);
+
+	/// @brief
+	/// 	Preallocates the storage of several elements.
+	/// @param
+	/// 	type - The type of the elements to preallocate.
+	/// @param
+	/// 	count - The count of elements that must be available in the free list.
+	/// @seealso
+	/// 	SetMaxFreeCount, Trim
+	inline void Reserve(usb_element_type type, size_t count);
+
+	/// @brief
+	/// 	Returns the storage kept in the free lists to the heap.
+	/// @seealso
+	/// 	Reserve
+	inline void Trim();
+
+	/// @brief
+	/// 	Gets the count of free elements available for a type.
+	inline size_t GetFreeCount(usb_element_type type) const;
+
+	/// @brief
+	/// 	Gets the count of elements of a type created from a free list.
+	/// @seealso
+	/// 	GetMissCount, ResetCounters
+	inline size_t GetHitCount(usb_element_type type) const;
+
+	/// @brief
+	/// 	Gets the count of elements created from a free list.
+	/// @seealso
+	/// 	GetMissCount, ResetCounters
+	inline size_t GetHitCount() const;
+
+	/// @brief
+	/// 	Gets the count of elements of a type allocated from the heap.
+	/// @remarks
+	/// 	Elements of user defined types are not counted.
+	/// @seealso
+	/// 	GetHitCount, ResetCounters
+	inline size_t GetMissCount(usb_element_type type) const;
+
+	/// @brief
+	/// 	Gets the count of elements allocated from the heap.
+	/// @remarks
+	/// 	Elements of user defined types are not counted.
+	/// @seealso
+	/// 	GetHitCount, ResetCounters
+	inline size_t GetMissCount() const;
+
+	/// @brief
+	/// 	Resets the hit and miss counters.
+	/// @seealso
+	/// 	GetHitCount, GetMissCount
+	inline void ResetCounters();
+
+private:
+	template<class TElement>
+	UsbElement* CreatePooledElement();
+
+	inline void* AllocateStorage(usb_element_type type, size_t size);
+	inline void RecycleStorage(usb_element_type type, void* pStorage);
+	inline void* PopStorage(usb_element_type type);
+	inline static size_t GetStorageSize(usb_element_type type);
+};
+
+/// @brief
+/// 	USB element created by UsbElementFactoryPooled.
+/// @remarks
+/// 	The element is allocated and deleted by its own operators new and 
+/// 	delete, which take its storage from the free list of the factory and 
+/// 	return it there. The elements are released with the usual virtual 
+/// 	destructor, the reference counting classes are unchanged.
+/// @seealso
+/// 	UsbElementFactoryPooled
+template<class TElement>
+class UsbPooledElement : public TElement
+{
+	friend class UsbElementFactoryPooled;
+
+private:
+	UsbPooledElement() {}
+
+	inline static void* operator new(size_t size, UsbElementFactoryPooled* pFactory);
+	inline static void operator delete(void* p, UsbElementFactoryPooled* pFactory);
+
+public:
+	inline static void operator delete(void* p);
+};
+
 /// @brief
 /// 	Manager of USB elements factories.
 /// @remarks
@@ -103,3 +279,5 @@ TElement* CreateElementInstance()
 }
 
 } // End of the usbdk namespace
+
+#include "UsbElementFactory.inl"
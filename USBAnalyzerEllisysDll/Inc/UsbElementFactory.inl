@@ -0,0 +1,334 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementFactory.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementFactoryPooled
+//---------------------------------------------------------------
+
+UsbElementFactoryPooled::UsbElementFactoryPooled() :
+	m_maxFreeCount((size_t) -1)
+{
+	InitializeCriticalSection(&m_lock);
+
+	for(size_t i=0; i<elementCount; ++i)
+	{
+		m_freeLists[i] = NULL;
+		m_freeCounts[i] = 0;
+	}
+
+	ResetCounters();
+}
+
+UsbElementFactoryPooled::~UsbElementFactoryPooled()
+{
+	Trim();
+	DeleteCriticalSection(&m_lock);
+}
+
+UsbElement* UsbElementFactoryPooled::CreateElement(usb_element_type type)
+{
+	C_ASSERT(elementCount == 11);
+	switch(type)
+	{
+	case elementInvalidPacket:
+		return CreatePooledElement<UsbInvalidPacket>();
+
+	case elementStartOfFrame:
+		return CreatePooledElement<UsbStartOfFrame>();
+
+	case elementTransaction:
+		return CreatePooledElement<UsbTransaction>();
+
+	case elementSplitTransaction:
+		return CreatePooledElement<UsbSplitTransaction>();
+
+	case elementLpmTransaction:
+		return CreatePooledElement<UsbLpmTransaction>();
+
+	case elementReset:
+		return CreatePooledElement<UsbReset>();
+
+	case elementSuspended:
+		return CreatePooledElement<UsbSuspended>();
+
+	case elementKeepAlive:
+		return CreatePooledElement<UsbKeepAlive>();
+
+	case elementPowerChange:
+		return CreatePooledElement<UsbPowerChange>();
+
+	case elementHighSpeedHandshake:
+		return CreatePooledElement<UsbHighSpeedHandshake>();
+
+	case elementTrigger:
+		return CreatePooledElement<UsbTrigger>();
+	}
+
+	return m_standardFactory.CreateElement(type);
+}
+
+void UsbElementFactoryPooled::SetMaxFreeCount(size_t count)
+{
+	EnterCriticalSection(&m_lock);
+
+	m_maxFreeCount = count;
+
+	for(size_t i=0; i<elementCount; ++i)
+	{
+		while(m_freeCounts[i] > m_maxFreeCount)
+		{
+			::operator delete(PopStorage((usb_element_type) i));
+		}
+	}
+
+	LeaveCriticalSection(&m_lock);
+}
+
+void UsbElementFactoryPooled::Reserve(usb_element_type type, size_t count)
+{
+	if(type >= elementCount)
+	{
+		return;
+	}
+
+	size_t storageSize = GetStorageSize(type);
+
+	EnterCriticalSection(&m_lock);
+
+	while((m_freeCounts[type] < count) && (m_freeCounts[type] < m_maxFreeCount))
+	{
+		free_storage* pFree = (free_storage*) ::operator new(storageSize);
+		pFree->pNext = m_freeLists[type];
+		m_freeLists[type] = pFree;
+		++m_freeCounts[type];
+	}
+
+	LeaveCriticalSection(&m_lock);
+}
+
+void UsbElementFactoryPooled::Trim()
+{
+	EnterCriticalSection(&m_lock);
+
+	for(size_t i=0; i<elementCount; ++i)
+	{
+		while(m_freeLists[i] != NULL)
+		{
+			::operator delete(PopStorage((usb_element_type) i));
+		}
+	}
+
+	LeaveCriticalSection(&m_lock);
+}
+
+size_t UsbElementFactoryPooled::GetFreeCount(usb_element_type type) const
+{
+	if(type >= elementCount)
+	{
+		return 0;
+	}
+
+	return m_freeCounts[type];
+}
+
+size_t UsbElementFactoryPooled::GetHitCount(usb_element_type type) const
+{
+	if(type >= elementCount)
+	{
+		return 0;
+	}
+
+	return m_hitCounts[type];
+}
+
+size_t UsbElementFactoryPooled::GetHitCount() const
+{
+	size_t count = 0;
+
+	for(size_t i=0; i<elementCount; ++i)
+	{
+		count += m_hitCounts[i];
+	}
+
+	return count;
+}
+
+size_t UsbElementFactoryPooled::GetMissCount(usb_element_type type) const
+{
+	if(type >= elementCount)
+	{
+		return 0;
+	}
+
+	return m_missCounts[type];
+}
+
+size_t UsbElementFactoryPooled::GetMissCount() const
+{
+	size_t count = 0;
+
+	for(size_t i=0; i<elementCount; ++i)
+	{
+		count += m_missCounts[i];
+	}
+
+	return count;
+}
+
+void UsbElementFactoryPooled::ResetCounters()
+{
+	for(size_t i=0; i<elementCount; ++i)
+	{
+		m_hitCounts[i] = 0;
+		m_missCounts[i] = 0;
+	}
+}
+
+void* UsbElementFactoryPooled::AllocateStorage(usb_element_type type, size_t size)
+{
+	ASSERT(type < elementCount);
+
+	EnterCriticalSection(&m_lock);
+
+	void* pStorage = PopStorage(type);
+
+	if(pStorage != NULL)
+	{
+		++m_hitCounts[type];
+	}
+	else
+	{
+		++m_missCounts[type];
+	}
+
+	LeaveCriticalSection(&m_lock);
+
+	if(pStorage == NULL)
+	{
+		pStorage = ::operator new(size);
+	}
+
+	return pStorage;
+}
+
+void UsbElementFactoryPooled::RecycleStorage(usb_element_type type, void* pStorage)
+{
+	ASSERT(type < elementCount);
+
+	EnterCriticalSection(&m_lock);
+
+	if(m_freeCounts[type] < m_maxFreeCount)
+	{
+		free_storage* pFree = (free_storage*) pStorage;
+		pFree->pNext = m_freeLists[type];
+		m_freeLists[type] = pFree;
+		++m_freeCounts[type];
+
+		pStorage = NULL;
+	}
+
+	LeaveCriticalSection(&m_lock);
+
+	if(pStorage != NULL)
+	{
+		::operator delete(pStorage);
+	}
+}
+
+template<class TElement>
+UsbElement* UsbElementFactoryPooled::CreatePooledElement()
+{
+	return new(this) UsbPooledElement<TElement>();
+}
+
+void* UsbElementFactoryPooled::PopStorage(usb_element_type type)
+{
+	free_storage* pFree = m_freeLists[type];
+
+	if(pFree != NULL)
+	{
+		m_freeLists[type] = pFree->pNext;
+		--m_freeCounts[type];
+	}
+
+	return pFree;
+}
+
+size_t UsbElementFactoryPooled::GetStorageSize(usb_element_type type)
+{
+	C_ASSERT(elementCount == 11);
+	switch(type)
+	{
+	case elementInvalidPacket:			return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbInvalidPacket>);
+	case elementStartOfFrame:			return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbStartOfFrame>);
+	case elementTransaction:			return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbTransaction>);
+	case elementSplitTransaction:		return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbSplitTransaction>);
+	case elementLpmTransaction:			return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbLpmTransaction>);
+	case elementReset:					return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbReset>);
+	case elementSuspended:				return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbSuspended>);
+	case elementKeepAlive:				return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbKeepAlive>);
+	case elementPowerChange:			return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbPowerChange>);
+	case elementHighSpeedHandshake:		return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbHighSpeedHandshake>);
+	case elementTrigger:				return sizeof(pooled_header) + sizeof(UsbPooledElement<UsbTrigger>);
+	}
+
+	return 0;
+}
+
+//---------------------------------------------------------------
+// UsbPooledElement
+//---------------------------------------------------------------
+
+template<class TElement>
+void* UsbPooledElement<TElement>::operator new(size_t size, UsbElementFactoryPooled* pFactory)
+{
+	typedef UsbElementFactoryPooled::pooled_header pooled_header;
+
+	pooled_header* pHeader = (pooled_header*) pFactory->AllocateStorage((usb_element_type) TElement::type, sizeof(pooled_header) + size);
+	pHeader->pFactory = pFactory;
+
+	// The element keeps the factory alive until its storage is recycled
+	pFactory->AddRef();
+
+	return pHeader + 1;
+}
+
+template<class TElement>
+void UsbPooledElement<TElement>::operator delete(void* p, UsbElementFactoryPooled*)
+{
+	operator delete(p);
+}
+
+template<class TElement>
+void UsbPooledElement<TElement>::operator delete(void* p)
+{
+	typedef UsbElementFactoryPooled::pooled_header pooled_header;
+
+	if(p == NULL)
+	{
+		return;
+	}
+
+	pooled_header* pHeader = ((pooled_header*) p) - 1;
+	UsbElementFactoryPooled* pFactory = pHeader->pFactory;
+
+	pFactory->RecycleStorage((usb_element_type) TElement::type, pHeader);
+	pFactory->Release();
+}
+
+}
@@ -13,6 +13,8 @@
 
 #pragma once
 
+#include <stdexcept>
+
 namespace usbdk {
 
 /////////////////////////////////////////////////////////////////////////////
@@ -49,6 +51,68 @@ public:
 	virtual void Inject(IUsbElementSink* pElementSink, usb_element_injector_progress_callback pProgressCallback, usb_element_injector_progress_param pProgressParam) /*throw(...)*/ = 0;
 };
 
+/////////////////////////////////////////////////////////////////////////////
+// IUsbElementChunkReducer
+
+/// @brief
+/// 	Creates and merges the sinks of a parallel injection.
+/// @remarks
+/// 	A parallel injection splits the elements into chunks. Each chunk is
+/// 	injected in its own sink, created by CreateChunkSink, then the result of
+/// 	each chunk sink is merged by ReduceChunkSink in the order of the chunks.
+///
+/// 	CreateChunkSink, ReduceChunkSink and DeleteChunkSink are called on the
+/// 	thread calling UsbElementsContainerInjector::InjectParallel. The chunk
+/// 	sinks are called by worker threads, a chunk sink by one thread only.
+/// @seealso
+/// 	UsbElementsContainerInjector::InjectParallel
+/// @sample
+/// \code
+/// class NakCountReducer : public usbdk::IUsbElementChunkReducer
+/// {
+/// public:
+///     size_t m_nakCount;
+/// 
+///     virtual usbdk::IUsbElementSink* CreateChunkSink(size_t chunkIndex) { return new NakCounter; }
+///     virtual void ReduceChunkSink(size_t chunkIndex, usbdk::IUsbElementSink* pChunkSink)
+///     {
+///         m_nakCount += static_cast<NakCounter*>(pChunkSink)->m_nakCount;
+///     }
+///     virtual void DeleteChunkSink(usbdk::IUsbElementSink* pChunkSink) { delete pChunkSink; }
+/// };
+/// \endcode
+class IUsbElementChunkReducer
+{
+public:
+	/// @brief
+	/// 	Creates the sink of a chunk.
+	/// @remarks
+	/// 	The chunk sink is typically a clone of the sink of a sequential injection.
+	/// @param
+	/// 	chunkIndex - The index of the chunk.
+	/// @return
+	/// 	The sink which will receive the elements of the chunk.
+	virtual IUsbElementSink* CreateChunkSink(size_t chunkIndex) = 0;
+
+	/// @brief
+	/// 	Merges the result of a chunk sink.
+	/// @remarks
+	/// 	The chunk sinks are merged in the order of their chunks, after they
+	/// 	have been finalized. They are not merged if the injection is stopped
+	/// 	or fails.
+	/// @param
+	/// 	chunkIndex - The index of the chunk.
+	/// @param
+	/// 	pChunkSink - The sink of the chunk.
+	virtual void ReduceChunkSink(size_t chunkIndex, IUsbElementSink* pChunkSink) = 0;
+
+	/// @brief
+	/// 	Deletes the sink of a chunk.
+	/// @param
+	/// 	pChunkSink - The sink created by CreateChunkSink.
+	virtual void DeleteChunkSink(IUsbElementSink* pChunkSink) = 0;
+};
+
 /////////////////////////////////////////////////////////////////////////////
 // UsbElementsContainerInjector
 
@@ -56,7 +120,31 @@ public:
 /// 	Injector of USB elements container.
 class UsbElementsContainerInjector : public IUsbElementInjector
 {
+public:
+	/// Default count of elements of the batches sent by InjectBatches.
+	enum { defaultBatchSize = 256 };
+
+	/// Count of chunks injected by each thread of InjectParallel.
+	enum { chunksPerThread = 4 };
+
 private:
+	/// State shared by the threads of InjectParallel.
+	struct parallel_injection
+	{
+		const container_usb_element* pElements;
+		std::vector<size_t> chunkBounds;
+		std::vector<IUsbElementSink*> chunkSinks;
+		volatile LONG nextChunk;
+		volatile LONG injectedCount;
+		volatile LONG isStopped;
+		volatile LONG hasFailed;
+		CRITICAL_SECTION errorLock;
+		size_t failedChunk;
+		std::string exceptionMessage;
+		std::tstring stringMessage;
+		bool isStringError;
+	};
+
 	container_usb_element* m_pElements;
 
 public:
@@ -79,6 +167,71 @@ public:
 
 public:
 	virtual void Inject(IUsbElementSink* pElementSink, usb_element_injector_progress_callback pProgressCallback, usb_element_injector_progress_param pProgressParam) /*throw(...)*/;
+
+	/// @brief
+	/// 	Injects the USB elements by batches.
+	/// @remarks
+	/// 	The sink is initialized, receives the elements of the container
+	/// 	with IUsbElementBatchSink::OnElementsArrival, then is finalized. A
+	/// 	sink not implementing IUsbElementBatchSink, like a 
+	/// 	ChainableUsbElementSinkManager, receives them one by one. The
+	/// 	progress callback is called between the batches, when the percentage
+	/// 	changes, and stops the injection when it returns false. The sink is
+	/// 	finalized even if the injection is stopped.
+	/// @param 
+	///		pElementSink - The sink which will receive USB elements.
+	/// @param 
+	///		pProgressCallback - The callback to notify the injection progress, or NULL.
+	/// @param 
+	///		pProgressParam - The parameter to pass to the callback.
+	/// @param 
+	///		batchSize - The maximum count of elements of a batch.
+	/// @seealso
+	/// 	Inject, IUsbElementBatchSink::OnElementsArrival
+	inline void InjectBatches(IUsbElementSink* pElementSink, usb_element_injector_progress_callback pProgressCallback, usb_element_injector_progress_param pProgressParam, size_t batchSize = defaultBatchSize) /*throw(...)*/;
+
+	/// @brief
+	/// 	Injects the USB elements in parallel.
+	/// @remarks
+	/// 	The container is split into chunks of about the same count of
+	/// 	elements. Each chunk, except the first, begins with a Start Of Frame,
+	/// 	so a chunk covers a range of frames. The chunks are injected by
+	/// 	batches in the sinks created by the reducer, each sink being
+	/// 	initialized and finalized by its worker thread. When all chunks are
+	/// 	injected, the sinks are merged by the reducer in the chunk order.
+	///
+	/// 	The progress callback is called on the calling thread with the
+	/// 	percentage of all injected elements. When it returns false, the
+	/// 	workers stop after their current batch and no sink is merged.
+	///
+	/// 	If a chunk sink throws an exception, the other workers stop and the
+	/// 	exception of the first failed chunk is thrown again, a std::exception
+	/// 	as a std::runtime_error with the same message. An exception thrown
+	/// 	by the progress callback stops the workers too, and is thrown again
+	/// 	once they have exited. If a worker thread cannot be created, the
+	/// 	started workers are stopped and a std::runtime_error is thrown.
+	///
+	/// 	The elements are referenced by several threads, so they must use the
+	/// 	multi-threaded reference counting policy (the default).
+	/// @param 
+	///		pReducer - Creates and merges the sinks of the chunks.
+	/// @param 
+	///		pProgressCallback - The callback to notify the injection progress, or NULL.
+	/// @param 
+	///		pProgressParam - The parameter to pass to the callback.
+	/// @param 
+	///		threadCount - The count of worker threads, or 0 for the count of processors.
+	/// @seealso
+	/// 	IUsbElementChunkReducer, InjectBatches
+	inline void InjectParallel(IUsbElementChunkReducer* pReducer, usb_element_injector_progress_callback pProgressCallback, usb_element_injector_progress_param pProgressParam, size_t threadCount = 0) /*throw(...)*/;
+
+private:
+	inline static void SplitChunks(const container_usb_element& elements, size_t chunkCount, std::vector<size_t>& chunkBounds);
+	inline static void JoinParallelWorkers(std::vector<HANDLE>& threads);
+	inline static void RunParallelWorker(parallel_injection& injection);
+	inline static DWORD WINAPI ParallelWorkerThreadProc(LPVOID pParameter);
 };
 
 } // End of the usbdk namespace
+
+#include "UsbElementInjector.inl"
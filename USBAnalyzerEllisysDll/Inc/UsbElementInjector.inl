@@ -0,0 +1,398 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementInjector.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementsContainerInjector
+//---------------------------------------------------------------
+
+void UsbElementsContainerInjector::InjectBatches(IUsbElementSink* pElementSink, usb_element_injector_progress_callback pProgressCallback, usb_element_injector_progress_param pProgressParam, size_t batchSize)
+{
+	ASSERT(pElementSink != NULL);
+
+	if(batchSize == 0)
+	{
+		batchSize = 1;
+	}
+
+	// The container is not contiguous, the batches are gathered in a buffer
+	std::vector<UsbElement*> batch;
+	batch.reserve(batchSize);
+
+	pElementSink->InitializeElementSink();
+
+	if(m_pElements != NULL)
+	{
+		const size_t totalCount = m_pElements->size();
+		size_t injectedCount = 0;
+		BYTE lastPercentDone = 0;
+
+		container_usb_element::const_iterator it = m_pElements->begin();
+
+		while(injectedCount < totalCount)
+		{
+			const size_t remainingCount = totalCount - injectedCount;
+			const size_t count = (remainingCount < batchSize) ? remainingCount : batchSize;
+
+			batch.clear();
+
+			for(size_t i=0; i<count; ++i, ++it)
+			{
+				batch.push_back(*it);
+			}
+
+			IUsbElementBatchSink::SendElements(pElementSink, &batch[0], count);
+			injectedCount += count;
+
+			if(pProgressCallback != NULL)
+			{
+				BYTE percentDone = (BYTE) ((DWORDLONG) injectedCount*100/totalCount);
+
+				if(percentDone != lastPercentDone)
+				{
+					lastPercentDone = percentDone;
+
+					if(!pProgressCallback(percentDone, pProgressParam))
+					{
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	pElementSink->FinalizeElementSink();
+}
+
+void UsbElementsContainerInjector::InjectParallel(IUsbElementChunkReducer* pReducer, usb_element_injector_progress_callback pProgressCallback, usb_element_injector_progress_param pProgressParam, size_t threadCount)
+{
+	ASSERT(pReducer != NULL);
+
+	if((m_pElements == NULL) || m_pElements->empty())
+	{
+		return;
+	}
+
+	if(threadCount == 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		threadCount = systemInfo.dwNumberOfProcessors;
+	}
+
+	if(threadCount == 0)
+	{
+		threadCount = 1;
+	}
+
+	if(threadCount > MAXIMUM_WAIT_OBJECTS)
+	{
+		threadCount = MAXIMUM_WAIT_OBJECTS;
+	}
+
+	parallel_injection injection;
+	injection.pElements = m_pElements;
+	injection.nextChunk = 0;
+	injection.injectedCount = 0;
+	injection.isStopped = 0;
+	injection.hasFailed = 0;
+	injection.failedChunk = 0;
+	injection.isStringError = false;
+
+	SplitChunks(*m_pElements, threadCount*chunksPerThread, injection.chunkBounds);
+
+	const size_t chunkCount = injection.chunkBounds.size() - 1;
+
+	if(threadCount > chunkCount)
+	{
+		threadCount = chunkCount;
+	}
+
+	// The handles are reserved first, so no allocation fails while workers run
+	std::vector<HANDLE> threads;
+	threads.reserve(threadCount);
+
+	try
+	{
+		for(size_t i=0; i<chunkCount; ++i)
+		{
+			injection.chunkSinks.push_back(pReducer->CreateChunkSink(i));
+		}
+	}
+	catch(...)
+	{
+		for(size_t i=0; i<injection.chunkSinks.size(); ++i)
+		{
+			pReducer->DeleteChunkSink(injection.chunkSinks[i]);
+		}
+
+		throw;
+	}
+
+	InitializeCriticalSection(&injection.errorLock);
+
+	for(size_t i=0; i<threadCount; ++i)
+	{
+		HANDLE hThread = CreateThread(NULL, 0, ParallelWorkerThreadProc, &injection, 0, NULL);
+
+		if(hThread == NULL)
+		{
+			// The started workers stop after their current batch
+			InterlockedExchange(&injection.isStopped, 1);
+			break;
+		}
+
+		threads.push_back(hThread);
+	}
+
+	const bool isStartFailed = (threads.size() < threadCount);
+
+	// The progress is reported on this thread, while the workers inject the chunks
+	const size_t totalCount = m_pElements->size();
+	BYTE lastPercentDone = 0;
+
+	try
+	{
+		while(!threads.empty())
+		{
+			const DWORD result = WaitForMultipleObjects((DWORD) threads.size(), &threads[0], TRUE, 100);
+
+			if((pProgressCallback != NULL) && (injection.isStopped == 0))
+			{
+				BYTE percentDone = (BYTE) ((DWORDLONG) injection.injectedCount*100/totalCount);
+
+				if(percentDone != lastPercentDone)
+				{
+					lastPercentDone = percentDone;
+
+					if(!pProgressCallback(percentDone, pProgressParam))
+					{
+						InterlockedExchange(&injection.isStopped, 1);
+					}
+				}
+			}
+
+			if(result != WAIT_TIMEOUT)
+			{
+				break;
+			}
+		}
+	}
+	catch(...)
+	{
+		// The workers use the injection, they must exit before it is destroyed
+		InterlockedExchange(&injection.isStopped, 1);
+		JoinParallelWorkers(threads);
+		DeleteCriticalSection(&injection.errorLock);
+
+		for(size_t i=0; i<chunkCount; ++i)
+		{
+			pReducer->DeleteChunkSink(injection.chunkSinks[i]);
+		}
+
+		throw;
+	}
+
+	JoinParallelWorkers(threads);
+	DeleteCriticalSection(&injection.errorLock);
+
+	if(isStartFailed)
+	{
+		for(size_t i=0; i<chunkCount; ++i)
+		{
+			pReducer->DeleteChunkSink(injection.chunkSinks[i]);
+		}
+
+		throw std::runtime_error("Cannot create the injection threads");
+	}
+
+	try
+	{
+		if(injection.isStopped == 0)
+		{
+			for(size_t i=0; i<chunkCount; ++i)
+			{
+				pReducer->ReduceChunkSink(i, injection.chunkSinks[i]);
+			}
+		}
+	}
+	catch(...)
+	{
+		for(size_t i=0; i<chunkCount; ++i)
+		{
+			pReducer->DeleteChunkSink(injection.chunkSinks[i]);
+		}
+
+		throw;
+	}
+
+	for(size_t i=0; i<chunkCount; ++i)
+	{
+		pReducer->DeleteChunkSink(injection.chunkSinks[i]);
+	}
+
+	if(injection.hasFailed != 0)
+	{
+		if(injection.isStringError)
+		{
+			throw injection.stringMessage;
+		}
+
+		throw std::runtime_error(injection.exceptionMessage);
+	}
+}
+
+void UsbElementsContainerInjector::SplitChunks(const container_usb_element& elements, size_t chunkCount, std::vector<size_t>& chunkBounds)
+{
+	const size_t totalCount = elements.size();
+
+	chunkBounds.clear();
+	chunkBounds.push_back(0);
+
+	for(size_t i=1; i<chunkCount; ++i)
+	{
+		size_t position = (size_t) ((DWORDLONG) totalCount*i/chunkCount);
+
+		if(position <= chunkBounds.back())
+		{
+			position = chunkBounds.back() + 1;
+		}
+
+		// A chunk begins with a Start Of Frame, so no frame is split
+		while((position < totalCount) && (elements[position]->GetElementType() != elementStartOfFrame))
+		{
+			++position;
+		}
+
+		if(position >= totalCount)
+		{
+			break;
+		}
+
+		chunkBounds.push_back(position);
+	}
+
+	chunkBounds.push_back(totalCount);
+}
+
+void UsbElementsContainerInjector::JoinParallelWorkers(std::vector<HANDLE>& threads)
+{
+	if(!threads.empty())
+	{
+		WaitForMultipleObjects((DWORD) threads.size(), &threads[0], TRUE, INFINITE);
+	}
+
+	for(size_t i=0; i<threads.size(); ++i)
+	{
+		CloseHandle(threads[i]);
+	}
+
+	threads.clear();
+}
+
+void UsbElementsContainerInjector::RunParallelWorker(parallel_injection& injection)
+{
+	const size_t chunkCount = injection.chunkSinks.size();
+
+	std::vector<UsbElement*> batch;
+	batch.reserve(defaultBatchSize);
+
+	for(;;)
+	{
+		const size_t chunk = (size_t) (InterlockedIncrement(&injection.nextChunk) - 1);
+
+		if((chunk >= chunkCount) || (injection.isStopped != 0))
+		{
+			break;
+		}
+
+		IUsbElementSink* pSink = injection.chunkSinks[chunk];
+
+		bool hasFailed = true;
+		bool isStringError = false;
+		std::string exceptionMessage;
+		std::tstring stringMessage;
+
+		try
+		{
+			pSink->InitializeElementSink();
+
+			container_usb_element::const_iterator it = injection.pElements->begin() + injection.chunkBounds[chunk];
+			size_t remainingCount = injection.chunkBounds[chunk + 1] - injection.chunkBounds[chunk];
+
+			while((remainingCount != 0) && (injection.isStopped == 0))
+			{
+				const size_t count = (remainingCount < defaultBatchSize) ? remainingCount : defaultBatchSize;
+
+				batch.clear();
+
+				for(size_t i=0; i<count; ++i, ++it)
+				{
+					batch.push_back(*it);
+				}
+
+				IUsbElementBatchSink::SendElements(pSink, &batch[0], count);
+
+				InterlockedExchangeAdd(&injection.injectedCount, (LONG) count);
+				remainingCount -= count;
+			}
+
+			pSink->FinalizeElementSink();
+			hasFailed = false;
+		}
+		catch(std::exception& e)
+		{
+			exceptionMessage = e.what();
+		}
+		catch(std::tstring& s)
+		{
+			isStringError = true;
+			stringMessage = s;
+		}
+		catch(...)
+		{
+			exceptionMessage = "Unknown error in an USB element sink";
+		}
+
+		if(hasFailed)
+		{
+			EnterCriticalSection(&injection.errorLock);
+
+			// The error of the first chunk is kept, whatever the order of the failures
+			if((injection.hasFailed == 0) || (chunk < injection.failedChunk))
+			{
+				injection.failedChunk = chunk;
+				injection.isStringError = isStringError;
+				injection.exceptionMessage = exceptionMessage;
+				injection.stringMessage = stringMessage;
+				injection.hasFailed = 1;
+			}
+
+			LeaveCriticalSection(&injection.errorLock);
+
+			InterlockedExchange(&injection.isStopped, 1);
+		}
+	}
+}
+
+DWORD WINAPI UsbElementsContainerInjector::ParallelWorkerThreadProc(LPVOID pParameter)
+{
+	RunParallelWorker(*static_cast<parallel_injection*>(pParameter));
+	return 0;
+}
+
+}
@@ -0,0 +1,201 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbElementRingBuffer.h
+/// @brief
+///		USB Analysis SDK element ring buffer declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementRingBuffer
+
+/// @brief
+/// 	Keeps the last USB elements in a preallocated ring.
+/// @remarks
+/// 	The capacity is rounded up to a power of two. Once the ring is full,
+/// 	each new element overwrites the oldest slot in place, no memory is
+/// 	allocated or freed while elements are pushed.
+///
+/// 	The ring has a single producer, calling Push and Clear, and any count
+/// 	of concurrent readers calling GetSnapshot. No lock is taken: the readers
+/// 	check the sequence number of each slot to skip the slots overwritten
+/// 	during the snapshot.
+///
+/// 	An evicted element may still be read by a reader. Its release is
+/// 	deferred by the producer until the snapshots started before its 
+/// 	eviction are completed. The readers are counted in two alternating 
+/// 	epochs, so the evicted elements are released even if the snapshots
+/// 	overlap continuously.
+/// @seealso
+/// 	UsbElementSinkRingStorage
+/// @sample
+/// \code
+/// // Poller thread
+/// usbdk::container_usb_element elements;
+/// ringBuffer.GetSnapshot(elements, 100);
+///
+/// DisplayElements(elements);
+///
+/// while(!elements.empty())
+/// {
+///     elements.front()->Release();
+///     elements.pop_front();
+/// }
+/// \endcode
+class UsbElementRingBuffer
+{
+private:
+	struct slot
+	{
+		volatile LONG sequence;
+		UsbElement* volatile pElement;
+	};
+
+	slot* m_pSlots;
+	size_t m_capacity;
+	DWORD m_mask;
+	volatile LONG m_writeCount;
+	volatile LONG m_count;
+	volatile LONG m_epoch;
+	mutable volatile LONG m_readerCounts[2];
+	std::vector<UsbElement*> m_deferredElements[2];
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementRingBuffer object.
+	/// @param
+	/// 	capacity - The count of elements kept by the ring,
+	///		rounded up to a power of two. The minimum is 2.
+	/// @seealso
+	/// 	~UsbElementRingBuffer()
+	inline explicit UsbElementRingBuffer(size_t capacity);
+
+	/// @brief
+	/// 	Destroys a UsbElementRingBuffer object.
+	/// @remarks
+	/// 	The elements of the ring are released.
+	///		No snapshot must be in progress.
+	/// @seealso
+	/// 	UsbElementRingBuffer()
+	inline ~UsbElementRingBuffer();
+
+public:
+	/// @brief
+	/// 	Gets the count of slots of the ring.
+	inline size_t GetCapacity() const;
+
+	/// @brief
+	/// 	Gets the count of elements in the ring.
+	inline size_t GetCount() const;
+
+	/// @brief
+	/// 	Gets the count of elements pushed since the creation or the last Clear.
+	/// @remarks
+	/// 	The counter wraps around after 2^32 elements.
+	inline DWORD GetPushedCount() const;
+
+	/// @brief
+	/// 	Gets the count of evicted elements waiting for their release.
+	/// @remarks
+	/// 	This method must be called by the producer thread.
+	inline size_t GetDeferredCount() const;
+
+public:
+	/// @brief
+	/// 	Adds an element to the ring.
+	/// @remarks
+	/// 	A reference is added on the element. The oldest element is evicted
+	/// 	if the ring is full. This method must be called by the producer thread.
+	/// @param
+	/// 	pElement - The element to add.
+	inline void Push(UsbElement* pElement);
+
+	/// @brief
+	/// 	Removes all the elements of the ring.
+	/// @remarks
+	/// 	This method must be called by the producer thread,
+	///		while no snapshot is in progress.
+	inline void Clear();
+
+	/// @brief
+	/// 	Copies the last elements of the ring.
+	/// @remarks
+	/// 	The elements are appended to the container from the oldest to the
+	/// 	newest, with a reference added on each of them. The caller must
+	///		release them. This method can be called by several threads
+	///		concurrently with the producer.
+	/// @param
+	/// 	elements - The container receiving the elements.
+	/// @param
+	/// 	maxCount - The maximum count of elements to copy.
+	/// @return
+	/// 	The count of elements appended to the container.
+	inline size_t GetSnapshot(container_usb_element& elements, size_t maxCount) const;
+
+private:
+	inline void ReleaseDeferredElements();
+
+private:
+	UsbElementRingBuffer(const UsbElementRingBuffer&);
+	UsbElementRingBuffer& operator=(const UsbElementRingBuffer&);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementSinkRingStorage
+
+/// @brief
+/// 	Stores the last USB elements into a ring buffer.
+/// @remarks
+/// 	The elements are pushed to a UsbElementRingBuffer. They are also
+/// 	given to UsbElementSinkStorage, which keeps them in the elements
+/// 	container if one was set with SetElementsContainer, and sends them
+/// 	to the next sink.
+///
+/// 	Unlike the circular buffer mode of UsbElementSinkStorage, the ring
+/// 	buffer does not allocate memory during the acquisition and can be
+/// 	read by other threads while the acquisition is running.
+/// @seealso
+/// 	UsbElementRingBuffer, UsbElementSinkStorage
+class UsbElementSinkRingStorage : public UsbElementSinkStorage
+{
+private:
+	UsbElementRingBuffer* m_pRingBuffer;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementSinkRingStorage object.
+	/// @seealso
+	/// 	~UsbElementSinkRingStorage()
+	inline UsbElementSinkRingStorage();
+
+	/// @brief
+	/// 	Destroys a UsbElementSinkRingStorage object.
+	/// @seealso
+	/// 	UsbElementSinkRingStorage()
+	inline virtual ~UsbElementSinkRingStorage();
+
+public:
+	/// @brief
+	/// 	Sets the ring buffer that will be used to store the elements.
+	inline void SetRingBuffer(UsbElementRingBuffer* pRingBuffer);
+
+	/// @brief
+	/// 	Gets the ring buffer used to store the elements.
+	inline UsbElementRingBuffer* GetRingBuffer();
+
+public:
+	inline virtual void OnElementArrival(UsbElement* pElement);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbElementRingBuffer.inl"
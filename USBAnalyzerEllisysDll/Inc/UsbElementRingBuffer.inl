@@ -0,0 +1,250 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementRingBuffer.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementRingBuffer
+//---------------------------------------------------------------
+
+UsbElementRingBuffer::UsbElementRingBuffer(size_t capacity) :
+	m_pSlots(NULL),
+	m_capacity(2),
+	m_writeCount(0),
+	m_count(0),
+	m_epoch(0)
+{
+	m_readerCounts[0] = 0;
+	m_readerCounts[1] = 0;
+
+	while(m_capacity < capacity)
+	{
+		m_capacity <<= 1;
+	}
+
+	m_mask = (DWORD) (m_capacity - 1);
+	m_pSlots = new slot[m_capacity];
+
+	for(size_t i=0; i<m_capacity; ++i)
+	{
+		// Never the sequence expected by a reader for this slot
+		m_pSlots[i].sequence = (LONG) (i - 1);
+		m_pSlots[i].pElement = NULL;
+	}
+
+	m_deferredElements[0].reserve(m_capacity);
+	m_deferredElements[1].reserve(m_capacity);
+}
+
+UsbElementRingBuffer::~UsbElementRingBuffer()
+{
+	Clear();
+	delete[] m_pSlots;
+}
+
+size_t UsbElementRingBuffer::GetCapacity() const
+{
+	return m_capacity;
+}
+
+size_t UsbElementRingBuffer::GetCount() const
+{
+	return (size_t) m_count;
+}
+
+DWORD UsbElementRingBuffer::GetPushedCount() const
+{
+	return (DWORD) m_writeCount;
+}
+
+size_t UsbElementRingBuffer::GetDeferredCount() const
+{
+	return m_deferredElements[0].size() + m_deferredElements[1].size();
+}
+
+void UsbElementRingBuffer::Push(UsbElement* pElement)
+{
+	ASSERT(pElement != NULL);
+	pElement->AddRef();
+
+	const DWORD sequence = (DWORD) m_writeCount;
+	slot& s = m_pSlots[sequence & m_mask];
+	UsbElement* pEvictedElement = s.pElement;
+
+	// Readers comparing the sequence before and after reading the
+	// element skip the slot while it is written
+	InterlockedExchange(&s.sequence, (LONG) (sequence - 1));
+	InterlockedExchangePointer((void* volatile*) &s.pElement, pElement);
+	InterlockedExchange(&s.sequence, (LONG) sequence);
+	InterlockedExchange(&m_writeCount, (LONG) (sequence + 1));
+
+	if((DWORD) m_count < m_capacity)
+	{
+		m_count = m_count + 1;
+	}
+
+	if(pEvictedElement != NULL)
+	{
+		m_deferredElements[m_epoch].push_back(pEvictedElement);
+	}
+
+	ReleaseDeferredElements();
+}
+
+void UsbElementRingBuffer::Clear()
+{
+	ASSERT((m_readerCounts[0] == 0) && (m_readerCounts[1] == 0));
+
+	for(size_t i=0; i<m_capacity; ++i)
+	{
+		if(m_pSlots[i].pElement != NULL)
+		{
+			m_pSlots[i].pElement->Release();
+			m_pSlots[i].pElement = NULL;
+		}
+
+		m_pSlots[i].sequence = (LONG) (i - 1);
+	}
+
+	m_writeCount = 0;
+	m_count = 0;
+
+	for(size_t epoch=0; epoch<2; ++epoch)
+	{
+		for(size_t i=0; i<m_deferredElements[epoch].size(); ++i)
+		{
+			m_deferredElements[epoch][i]->Release();
+		}
+
+		m_deferredElements[epoch].clear();
+	}
+}
+
+size_t UsbElementRingBuffer::GetSnapshot(container_usb_element& elements, size_t maxCount) const
+{
+	// The producer does not release the elements evicted during
+	// the epoch of a registered reader
+	LONG epoch;
+
+	for(;;)
+	{
+		epoch = m_epoch;
+		InterlockedIncrement(&m_readerCounts[epoch]);
+
+		if(m_epoch == epoch)
+		{
+			break;
+		}
+
+		InterlockedDecrement(&m_readerCounts[epoch]);
+	}
+
+	const DWORD writeCount = (DWORD) m_writeCount;
+	size_t count = (size_t) m_count;
+
+	if(count > maxCount)
+	{
+		count = maxCount;
+	}
+
+	size_t copiedCount = 0;
+
+	for(DWORD sequence = writeCount - (DWORD) count; sequence != writeCount; ++sequence)
+	{
+		const slot& s = m_pSlots[sequence & m_mask];
+
+		LONG sequenceBefore = s.sequence;
+		UsbElement* pElement = s.pElement;
+		LONG sequenceAfter = s.sequence;
+
+		if((sequenceBefore != (LONG) sequence) || (sequenceAfter != (LONG) sequence) || (pElement == NULL))
+		{
+			// Overwritten by the producer during the snapshot
+			continue;
+		}
+
+		pElement->AddRef();
+		elements.push_back(pElement);
+		++copiedCount;
+	}
+
+	InterlockedDecrement(&m_readerCounts[epoch]);
+
+	return copiedCount;
+}
+
+void UsbElementRingBuffer::ReleaseDeferredElements()
+{
+	const LONG epoch = m_epoch;
+	const LONG previousEpoch = 1 - epoch;
+
+	// Full barrier: the evicted elements are no longer visible in the slots.
+	// The readers of the previous epoch started before the elements of the
+	// previous epoch were evicted, the new readers register in the current epoch.
+	if(InterlockedCompareExchange(&m_readerCounts[previousEpoch], 0, 0) != 0)
+	{
+		return;
+	}
+
+	std::vector<UsbElement*>& previousElements = m_deferredElements[previousEpoch];
+
+	for(size_t i=0; i<previousElements.size(); ++i)
+	{
+		previousElements[i]->Release();
+	}
+
+	previousElements.clear();
+
+	if(!m_deferredElements[epoch].empty())
+	{
+		InterlockedExchange(&m_epoch, previousEpoch);
+	}
+}
+
+//---------------------------------------------------------------
+// UsbElementSinkRingStorage
+//---------------------------------------------------------------
+
+UsbElementSinkRingStorage::UsbElementSinkRingStorage() :
+	m_pRingBuffer(NULL)
+{
+}
+
+UsbElementSinkRingStorage::~UsbElementSinkRingStorage()
+{
+}
+
+void UsbElementSinkRingStorage::SetRingBuffer(UsbElementRingBuffer* pRingBuffer)
+{
+	m_pRingBuffer = pRingBuffer;
+}
+
+UsbElementRingBuffer* UsbElementSinkRingStorage::GetRingBuffer()
+{
+	return m_pRingBuffer;
+}
+
+void UsbElementSinkRingStorage::OnElementArrival(UsbElement* pElement)
+{
+	if(m_pRingBuffer != NULL)
+	{
+		m_pRingBuffer->Push(pElement);
+	}
+
+	UsbElementSinkStorage::OnElementArrival(pElement);
+}
+
+}
@@ -0,0 +1,344 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbElementRunCollapser.h
+/// @brief
+///		USB Analysis SDK run collapsing declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/// @brief
+///		Type of the UsbElementRun elements.
+/// @remarks
+///		The type is taken at the end of the user defined element types.
+/// @seealso
+///		UsbElementRun, elementUserDefined
+static const usb_element_type elementRun = (usb_element_type) (elementUserDefined + 0x7F00);
+
+//---------------------------------------------------------------
+// UsbElementRun
+//---------------------------------------------------------------
+
+/// @brief
+/// 	Represents a run of idle traffic collapsed in a single element.
+/// @remarks
+/// 	A run holds consecutive Start-of-Frames and NAKed transactions without
+/// 	data, the IN and PING transactions polling an endpoint, in their order
+/// 	on the bus. Each collapsed element costs a few bytes of time offsets,
+/// 	and the elements are created again on demand by Expand, identical to
+/// 	the collapsed ones.
+///
+/// 	The Start-of-Frames of a run follow each other without gap, so their
+/// 	frame numbers are known from the first and the last ones.
+/// @seealso
+/// 	UsbElementRunCollapser, UsbElementRunExpander, elementRun
+class UsbElementRun : public UsbElement
+{
+	friend class UsbElementRunCollapser;
+
+public:
+	enum { type = elementRun };
+
+private:
+	// The time of an element is an offset from the previous one, and the
+	// stream is 0 for a Start-of-Frame or the index of a token plus 1
+#pragma pack(push, 1)
+	struct run_entry
+	{
+		DWORD ticksOffset;
+		DWORD handshakeOffset;
+		BYTE stream;
+	};
+#pragma pack(pop)
+
+	std::vector<run_entry> m_entries;
+	std::vector<UsbPacketToken> m_tokens;
+	usb_ticks m_firstTicks;
+	usb_ticks m_lastTicks;
+	size_t m_frameCount;
+	usb_speed m_frameSpeed;
+	usb_frame_number m_firstFrameNumber;
+	usb_microframe_number m_firstMicroFrameNumber;
+	usb_frame_number m_lastFrameNumber;
+	usb_microframe_number m_lastMicroFrameNumber;
+	bool m_firstNonConsecutive;
+
+public:
+	/// @brief
+	/// 	Constructs an empty UsbElementRun object.
+	/// @seealso
+	/// 	~UsbElementRun()
+	inline UsbElementRun();
+
+	/// @brief
+	/// 	Destroys an UsbElementRun object.
+	/// @seealso
+	/// 	UsbElementRun()
+	inline virtual ~UsbElementRun();
+
+public:
+	inline virtual usb_element_type GetElementType() const;
+	inline virtual usb_time GetTime() const;
+
+public:
+	/// @brief
+	/// 	Gets the time of the first element of the run.
+	/// @remarks
+	/// 	The time is the one of the first packet of the run. It is not
+	/// 	converted back from GetTime like UsbElement::GetTicks.
+	/// @seealso
+	/// 	GetLastTicks
+	inline usb_ticks GetFirstTicks() const;
+
+public:
+	/// @brief
+	/// 	Gets the count of elements collapsed in the run.
+	inline size_t GetCount() const;
+
+	/// @brief
+	/// 	Gets the count of Start-of-Frames collapsed in the run.
+	inline size_t GetStartOfFrameCount() const;
+
+	/// @brief
+	/// 	Gets the count of NAKed transactions collapsed in the run.
+	inline size_t GetTransactionCount() const;
+
+	/// @brief
+	/// 	Gets the time of the last element of the run.
+	/// @seealso
+	/// 	GetFirstTicks
+	inline usb_ticks GetLastTicks() const;
+
+	/// @brief
+	/// 	Gets the frame number of the first Start-of-Frame of the run.
+	/// @return
+	/// 	The frame number, or unknown_frame_number if the run has no Start-of-Frame.
+	inline usb_frame_number GetFirstFrameNumber() const;
+
+	/// @brief
+	/// 	Gets the micro-frame number of the first Start-of-Frame of the run.
+	inline usb_microframe_number GetFirstMicroFrameNumber() const;
+
+	/// @brief
+	/// 	Gets the frame number of the last Start-of-Frame of the run.
+	/// @return
+	/// 	The frame number, or unknown_frame_number if the run has no Start-of-Frame.
+	inline usb_frame_number GetLastFrameNumber() const;
+
+	/// @brief
+	/// 	Gets the micro-frame number of the last Start-of-Frame of the run.
+	inline usb_microframe_number GetLastMicroFrameNumber() const;
+
+	/// @brief
+	/// 	Gets the count of endpoints polled in the run.
+	inline size_t GetTokenCount() const;
+
+	/// @brief
+	/// 	Gets the token packet of an endpoint polled in the run.
+	/// @remarks
+	/// 	The time of the packet is the time of its first transaction.
+	/// @param
+	/// 	index - The index of the token, lower than GetTokenCount.
+	inline const UsbPacketToken& GetTokenPacket(size_t index) const;
+
+	/// @brief
+	/// 	Creates the elements collapsed in the run.
+	/// @remarks
+	/// 	The elements are created by the current element factory and
+	/// 	appended to the container in their order, each with a reference
+	/// 	count of 1.
+	/// @param
+	/// 	elements - The container receiving the elements.
+	/// @seealso
+	/// 	UsbElementRunExpander
+	inline void Expand(container_usb_element& elements) const;
+
+private:
+	inline void Clear();
+	inline static void StepFrame(usb_frame_number& frameNumber, usb_microframe_number& microFrameNumber);
+	inline bool AddEntry(usb_ticks ticks, usb_ticks handshakeTicks, size_t stream);
+	inline bool AddStartOfFrame(const UsbStartOfFrame* pStartOfFrame);
+	inline bool AddTransaction(const UsbTransaction* pTransaction, size_t maxTokenCount);
+
+private:
+	UsbElementRun(const UsbElementRun&);
+	UsbElementRun& operator=(const UsbElementRun&);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementRunCollapser
+
+/// @brief
+/// 	Collapses the idle traffic in runs.
+/// @remarks
+/// 	The consecutive Start-of-Frames and the identical NAKed IN and PING
+/// 	transactions between them are replaced by a UsbElementRun, so the next
+/// 	sinks only receive the elements that matter. Any other element ends the
+/// 	current run, which is sent before it. An idle high speed bus then sends
+/// 	one run per maximum run length instead of 8000 Start-of-Frames per second.
+///
+/// 	A run also ends when its maximum length is reached, when it would poll
+/// 	more endpoints than the maximum token count, when a Start-of-Frame does
+/// 	not follow the previous one, or when two elements are more than 4 ms
+/// 	apart. A run of a single element is not collapsed, the element is sent
+/// 	as is. The current run is sent by FinalizeElementSink.
+/// @seealso
+/// 	UsbElementRun, UsbElementRunExpander
+/// @sample
+/// \code
+/// usbdk::UsbElementRunCollapser collapser;
+///
+/// usbdk::ChainableUsbElementSinkManager sinkChainer;
+/// sinkChainer.AddElementSink(&collapser);
+/// sinkChainer.AddElementSink(&storage);
+/// pAnalyzer->BeginAcquisition(&sinkChainer);
+/// ...
+/// if(pElement->GetElementType() == usbdk::elementRun)
+/// {
+///     usbdk::container_usb_element elements;
+///     static_cast<const usbdk::UsbElementRun*>(pElement)->Expand(elements);
+///     ...
+/// }
+/// \endcode
+class UsbElementRunCollapser : public ChainableUsbElementSink, public IUsbElementBatchSink
+{
+public:
+	enum
+	{
+		defaultMaxRunLength = 8000,		///< Default maximum count of elements of a run
+		defaultMaxTokenCount = 16,		///< Default maximum count of endpoints polled in a run
+	};
+
+private:
+	UsbElementRun* m_pRun;
+	UsbElement* m_pFirstElement;
+	size_t m_maxRunLength;
+	size_t m_maxTokenCount;
+	std::vector<UsbElement*> m_output;
+	std::vector<UsbElement*> m_released;
+	DWORDLONG m_collapsedCount;
+	DWORDLONG m_runCount;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementRunCollapser object.
+	/// @seealso
+	/// 	~UsbElementRunCollapser()
+	inline UsbElementRunCollapser();
+
+	/// @brief
+	/// 	Destroys a UsbElementRunCollapser object.
+	/// @seealso
+	/// 	UsbElementRunCollapser()
+	inline virtual ~UsbElementRunCollapser();
+
+public:
+	/// @brief
+	/// 	Sets the maximum count of elements of a run.
+	/// @remarks
+	/// 	The default length is defaultMaxRunLength, one second of high speed
+	/// 	micro-frames. A shorter run reaches the next sinks sooner.
+	inline void SetMaxRunLength(size_t length);
+
+	/// @brief
+	/// 	Gets the maximum count of elements of a run.
+	inline size_t GetMaxRunLength() const;
+
+	/// @brief
+	/// 	Sets the maximum count of endpoints polled in a run.
+	/// @remarks
+	/// 	The count is limited to 255. The default count is defaultMaxTokenCount.
+	inline void SetMaxTokenCount(size_t count);
+
+	/// @brief
+	/// 	Gets the maximum count of endpoints polled in a run.
+	inline size_t GetMaxTokenCount() const;
+
+	/// @brief
+	/// 	Gets the count of elements collapsed since InitializeElementSink.
+	inline DWORDLONG GetCollapsedCount() const;
+
+	/// @brief
+	/// 	Gets the count of runs sent since InitializeElementSink.
+	inline DWORDLONG GetRunCount() const;
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	A derived class overriding this method must call it.
+	inline virtual void InitializeElementSink();
+
+	inline virtual void OnElementArrival(UsbElement* pElement);
+	inline virtual void OnElementsArrival(UsbElement* const* ppElements, size_t count);
+
+	/// @brief
+	/// 	Finalizes the sink.
+	/// @remarks
+	/// 	The current run is sent. A derived class overriding this method
+	/// 	must call it.
+	inline virtual void FinalizeElementSink();
+
+private:
+	inline void Collapse(UsbElement* pElement);
+	inline bool AddToRun(UsbElement* pElement);
+	inline void EndRun();
+	inline void SendOutput();
+
+private:
+	UsbElementRunCollapser(const UsbElementRunCollapser&);
+	UsbElementRunCollapser& operator=(const UsbElementRunCollapser&);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementRunExpander
+
+/// @brief
+/// 	Expands the runs collapsed by a UsbElementRunCollapser.
+/// @remarks
+/// 	The runs are replaced by the elements they hold, the other elements
+/// 	are sent as is. The next sinks receive the same elements as if the
+/// 	runs had never been collapsed, for instance when the stored elements
+/// 	are injected again.
+/// @seealso
+/// 	UsbElementRun, UsbElementRunCollapser
+class UsbElementRunExpander : public ChainableUsbElementSink, public IUsbElementBatchSink
+{
+private:
+	container_usb_element m_expanded;
+	std::vector<UsbElement*> m_output;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementRunExpander object.
+	/// @seealso
+	/// 	~UsbElementRunExpander()
+	inline UsbElementRunExpander();
+
+	/// @brief
+	/// 	Destroys a UsbElementRunExpander object.
+	/// @seealso
+	/// 	UsbElementRunExpander()
+	inline virtual ~UsbElementRunExpander();
+
+public:
+	inline virtual void InitializeElementSink();
+	inline virtual void OnElementArrival(UsbElement* pElement);
+	inline virtual void OnElementsArrival(UsbElement* const* ppElements, size_t count);
+	inline virtual void FinalizeElementSink();
+
+private:
+	inline void ReleaseExpanded();
+};
+
+} // End of the usbdk namespace
+
+#include "UsbElementRunCollapser.inl"
@@ -0,0 +1,559 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementRunCollapser.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementRun
+//---------------------------------------------------------------
+
+UsbElementRun::UsbElementRun()
+{
+	Clear();
+}
+
+UsbElementRun::~UsbElementRun()
+{
+}
+
+usb_element_type UsbElementRun::GetElementType() const
+{
+	return elementRun;
+}
+
+usb_time UsbElementRun::GetTime() const
+{
+	return UsbTicksToTime(m_firstTicks);
+}
+
+usb_ticks UsbElementRun::GetFirstTicks() const
+{
+	return m_firstTicks;
+}
+
+size_t UsbElementRun::GetCount() const
+{
+	return m_entries.size();
+}
+
+size_t UsbElementRun::GetStartOfFrameCount() const
+{
+	return m_frameCount;
+}
+
+size_t UsbElementRun::GetTransactionCount() const
+{
+	return m_entries.size() - m_frameCount;
+}
+
+usb_ticks UsbElementRun::GetLastTicks() const
+{
+	return m_lastTicks;
+}
+
+usb_frame_number UsbElementRun::GetFirstFrameNumber() const
+{
+	return m_firstFrameNumber;
+}
+
+usb_microframe_number UsbElementRun::GetFirstMicroFrameNumber() const
+{
+	return m_firstMicroFrameNumber;
+}
+
+usb_frame_number UsbElementRun::GetLastFrameNumber() const
+{
+	return m_lastFrameNumber;
+}
+
+usb_microframe_number UsbElementRun::GetLastMicroFrameNumber() const
+{
+	return m_lastMicroFrameNumber;
+}
+
+size_t UsbElementRun::GetTokenCount() const
+{
+	return m_tokens.size();
+}
+
+const UsbPacketToken& UsbElementRun::GetTokenPacket(size_t index) const
+{
+	return m_tokens[index];
+}
+
+void UsbElementRun::Expand(container_usb_element& elements) const
+{
+	const BYTE nakRawData = pidNAK;
+	usb_ticks ticks = m_firstTicks;
+	usb_frame_number frameNumber = m_firstFrameNumber;
+	usb_microframe_number microFrameNumber = m_firstMicroFrameNumber;
+	bool isFirstFrame = true;
+
+	for(size_t i=0; i<m_entries.size(); ++i)
+	{
+		const run_entry& entry = m_entries[i];
+		UsbElement* pElement;
+
+		ticks += entry.ticksOffset;
+
+		if(entry.stream == 0)
+		{
+			// The raw data of a valid Start-of-Frame is given by its frame number
+			UsbPacketStartOfFrame packet(UsbPacketStartOfFrame::PrepareRawData(frameNumber), UsbTicksToTime(ticks), m_frameSpeed);
+			packet.SetTicks(ticks);
+
+			UsbStartOfFrame* pStartOfFrame = CreateElementInstance<UsbStartOfFrame>();
+			pStartOfFrame->SetPacket(packet);
+			pStartOfFrame->SetMicroFrameNumber(microFrameNumber);
+			pStartOfFrame->SetNonConsecutive(isFirstFrame && m_firstNonConsecutive);
+			pElement = pStartOfFrame;
+
+			StepFrame(frameNumber, microFrameNumber);
+			isFirstFrame = false;
+		}
+		else
+		{
+			UsbPacketToken token(m_tokens[entry.stream - 1]);
+			token.SetTicks(ticks);
+
+			const usb_ticks handshakeTicks = ticks + entry.handshakeOffset;
+			UsbPacketHandshake handshake(&nakRawData, 1, UsbTicksToTime(handshakeTicks), token.GetSpeed());
+			handshake.SetTicks(handshakeTicks);
+
+			UsbTransaction* pTransaction = CreateElementInstance<UsbTransaction>();
+			pTransaction->SetTokenPacket(token);
+			pTransaction->SetDataPacket(UsbPacketData());
+			pTransaction->SetHandshakePacket(handshake);
+			pElement = pTransaction;
+		}
+
+		pElement->AddRef();
+		elements.push_back(pElement);
+	}
+}
+
+void UsbElementRun::Clear()
+{
+	m_entries.clear();
+	m_tokens.clear();
+	m_firstTicks = 0;
+	m_lastTicks = 0;
+	m_frameCount = 0;
+	m_frameSpeed = speedUnknown;
+	m_firstFrameNumber = unknown_frame_number;
+	m_firstMicroFrameNumber = no_microframe_number;
+	m_lastFrameNumber = unknown_frame_number;
+	m_lastMicroFrameNumber = no_microframe_number;
+	m_firstNonConsecutive = false;
+}
+
+void UsbElementRun::StepFrame(usb_frame_number& frameNumber, usb_microframe_number& microFrameNumber)
+{
+	if(microFrameNumber < max_microframe_number)
+	{
+		++microFrameNumber;
+		return;
+	}
+
+	// The full speed frames have no micro-frame
+	if(microFrameNumber == max_microframe_number)
+	{
+		microFrameNumber = 0;
+	}
+
+	frameNumber = (usb_frame_number) ((frameNumber + 1) & max_frame_number);
+}
+
+bool UsbElementRun::AddEntry(usb_ticks ticks, usb_ticks handshakeTicks, size_t stream)
+{
+	const usb_ticks previousTicks = m_entries.empty() ? ticks : m_lastTicks;
+
+	// The offsets must fit in 32 bits, about 4 ms
+	if((ticks < previousTicks) || (ticks - previousTicks > 0xFFFFFFFF) ||
+		(handshakeTicks < ticks) || (handshakeTicks - ticks > 0xFFFFFFFF))
+	{
+		return false;
+	}
+
+	if(m_entries.empty())
+	{
+		m_firstTicks = ticks;
+	}
+
+	run_entry entry;
+	entry.ticksOffset = (DWORD) (ticks - previousTicks);
+	entry.handshakeOffset = (DWORD) (handshakeTicks - ticks);
+	entry.stream = (BYTE) stream;
+	m_entries.push_back(entry);
+
+	m_lastTicks = ticks;
+	return true;
+}
+
+bool UsbElementRun::AddStartOfFrame(const UsbStartOfFrame* pStartOfFrame)
+{
+	const UsbPacketStartOfFrame& packet = pStartOfFrame->GetPacket();
+
+	if(!pStartOfFrame->IsValid() || (packet.GetRawData().size() != packetSizeStartOfFrame))
+	{
+		return false;
+	}
+
+	const usb_frame_number frameNumber = pStartOfFrame->GetFrameNumber();
+	const usb_microframe_number microFrameNumber = pStartOfFrame->GetMicroFrameNumber();
+
+	if(m_frameCount != 0)
+	{
+		usb_frame_number nextFrameNumber = m_lastFrameNumber;
+		usb_microframe_number nextMicroFrameNumber = m_lastMicroFrameNumber;
+		StepFrame(nextFrameNumber, nextMicroFrameNumber);
+
+		if(pStartOfFrame->GetNonConsecutive() || (packet.GetSpeed() != m_frameSpeed) ||
+			(frameNumber != nextFrameNumber) || (microFrameNumber != nextMicroFrameNumber))
+		{
+			return false;
+		}
+	}
+
+	const usb_ticks ticks = packet.GetTicks();
+
+	if(!AddEntry(ticks, ticks, 0))
+	{
+		return false;
+	}
+
+	if(m_frameCount == 0)
+	{
+		m_frameSpeed = packet.GetSpeed();
+		m_firstFrameNumber = frameNumber;
+		m_firstMicroFrameNumber = microFrameNumber;
+		m_firstNonConsecutive = pStartOfFrame->GetNonConsecutive();
+	}
+
+	m_lastFrameNumber = frameNumber;
+	m_lastMicroFrameNumber = microFrameNumber;
+	++m_frameCount;
+
+	return true;
+}
+
+bool UsbElementRun::AddTransaction(const UsbTransaction* pTransaction, size_t maxTokenCount)
+{
+	const UsbPacketToken& token = pTransaction->GetTokenPacket();
+	const UsbPacketHandshake& handshake = pTransaction->GetHandshakePacket();
+	const usb_pid tokenPid = token.GetPID();
+
+	if(!pTransaction->IsValid() || ((tokenPid != pidIN) && (tokenPid != pidPING)) ||
+		!pTransaction->GetDataPacket().IsEmpty() || (handshake.GetPID() != pidNAK) ||
+		(handshake.GetRawData().size() != packetSizeHandshake) || (handshake.GetSpeed() != token.GetSpeed()))
+	{
+		return false;
+	}
+
+	size_t index = 0;
+
+	while((index < m_tokens.size()) &&
+		((m_tokens[index].GetSpeed() != token.GetSpeed()) || (m_tokens[index].GetRawData() != token.GetRawData())))
+	{
+		++index;
+	}
+
+	if((index == m_tokens.size()) && (index >= maxTokenCount))
+	{
+		return false;
+	}
+
+	if(!AddEntry(token.GetTicks(), handshake.GetTicks(), index + 1))
+	{
+		return false;
+	}
+
+	if(index == m_tokens.size())
+	{
+		m_tokens.push_back(token);
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------
+// UsbElementRunCollapser
+//---------------------------------------------------------------
+
+UsbElementRunCollapser::UsbElementRunCollapser() :
+	m_pRun(NULL),
+	m_pFirstElement(NULL),
+	m_maxRunLength(defaultMaxRunLength),
+	m_maxTokenCount(defaultMaxTokenCount),
+	m_collapsedCount(0),
+	m_runCount(0)
+{
+}
+
+UsbElementRunCollapser::~UsbElementRunCollapser()
+{
+	if(m_pFirstElement != NULL)
+	{
+		m_pFirstElement->Release();
+	}
+
+	if(m_pRun != NULL)
+	{
+		m_pRun->Release();
+	}
+}
+
+void UsbElementRunCollapser::SetMaxRunLength(size_t length)
+{
+	m_maxRunLength = (length > 0) ? length : 1;
+}
+
+size_t UsbElementRunCollapser::GetMaxRunLength() const
+{
+	return m_maxRunLength;
+}
+
+void UsbElementRunCollapser::SetMaxTokenCount(size_t count)
+{
+	m_maxTokenCount = (count < 255) ? count : 255;
+}
+
+size_t UsbElementRunCollapser::GetMaxTokenCount() const
+{
+	return m_maxTokenCount;
+}
+
+DWORDLONG UsbElementRunCollapser::GetCollapsedCount() const
+{
+	return m_collapsedCount;
+}
+
+DWORDLONG UsbElementRunCollapser::GetRunCount() const
+{
+	return m_runCount;
+}
+
+void UsbElementRunCollapser::InitializeElementSink()
+{
+	if(m_pFirstElement != NULL)
+	{
+		m_pFirstElement->Release();
+		m_pFirstElement = NULL;
+	}
+
+	if(m_pRun != NULL)
+	{
+		m_pRun->Clear();
+	}
+
+	m_collapsedCount = 0;
+	m_runCount = 0;
+}
+
+void UsbElementRunCollapser::OnElementArrival(UsbElement* pElement)
+{
+	Collapse(pElement);
+	SendOutput();
+}
+
+void UsbElementRunCollapser::OnElementsArrival(UsbElement* const* ppElements, size_t count)
+{
+	for(size_t i=0; i<count; ++i)
+	{
+		Collapse(ppElements[i]);
+	}
+
+	SendOutput();
+}
+
+void UsbElementRunCollapser::FinalizeElementSink()
+{
+	EndRun();
+	SendOutput();
+}
+
+void UsbElementRunCollapser::Collapse(UsbElement* pElement)
+{
+	if(AddToRun(pElement))
+	{
+		return;
+	}
+
+	// The element may begin the next run
+	EndRun();
+
+	if(!AddToRun(pElement))
+	{
+		m_output.push_back(pElement);
+	}
+}
+
+bool UsbElementRunCollapser::AddToRun(UsbElement* pElement)
+{
+	const usb_element_type type = pElement->GetElementType();
+
+	if((type != elementStartOfFrame) && (type != elementTransaction))
+	{
+		return false;
+	}
+
+	if(m_pRun == NULL)
+	{
+		m_pRun = CreateInstance<UsbElementRun>();
+	}
+
+	const bool isAdded = (type == elementStartOfFrame) ?
+		m_pRun->AddStartOfFrame(static_cast<const UsbStartOfFrame*>(pElement)) :
+		m_pRun->AddTransaction(static_cast<const UsbTransaction*>(pElement), m_maxTokenCount);
+
+	if(!isAdded)
+	{
+		return false;
+	}
+
+	// The first element is sent as is if the run ends without another one
+	if(m_pRun->GetCount() == 1)
+	{
+		pElement->AddRef();
+		m_pFirstElement = pElement;
+	}
+
+	if(m_pRun->GetCount() >= m_maxRunLength)
+	{
+		EndRun();
+	}
+
+	return true;
+}
+
+void UsbElementRunCollapser::EndRun()
+{
+	if((m_pRun == NULL) || (m_pRun->GetCount() == 0))
+	{
+		return;
+	}
+
+	if(m_pRun->GetCount() == 1)
+	{
+		m_output.push_back(m_pFirstElement);
+		m_pRun->Clear();
+	}
+	else
+	{
+		m_collapsedCount += m_pRun->GetCount();
+		++m_runCount;
+
+		m_output.push_back(m_pRun);
+		m_released.push_back(m_pRun);
+		m_pRun = NULL;
+	}
+
+	// The elements are released once the next sinks received them
+	m_released.push_back(m_pFirstElement);
+	m_pFirstElement = NULL;
+}
+
+void UsbElementRunCollapser::SendOutput()
+{
+	if(m_output.size() == 1)
+	{
+		SendToNextSink(m_output[0]);
+	}
+	else if(!m_output.empty())
+	{
+		SendToNextSink(&m_output[0], m_output.size());
+	}
+
+	m_output.clear();
+
+	for(size_t i=0; i<m_released.size(); ++i)
+	{
+		m_released[i]->Release();
+	}
+
+	m_released.clear();
+}
+
+//---------------------------------------------------------------
+// UsbElementRunExpander
+//---------------------------------------------------------------
+
+UsbElementRunExpander::UsbElementRunExpander()
+{
+}
+
+UsbElementRunExpander::~UsbElementRunExpander()
+{
+	ReleaseExpanded();
+}
+
+void UsbElementRunExpander::InitializeElementSink()
+{
+}
+
+void UsbElementRunExpander::OnElementArrival(UsbElement* pElement)
+{
+	if(pElement->GetElementType() != elementRun)
+	{
+		SendToNextSink(pElement);
+		return;
+	}
+
+	OnElementsArrival(&pElement, 1);
+}
+
+void UsbElementRunExpander::OnElementsArrival(UsbElement* const* ppElements, size_t count)
+{
+	for(size_t i=0; i<count; ++i)
+	{
+		UsbElement* pElement = ppElements[i];
+
+		if(pElement->GetElementType() == elementRun)
+		{
+			const size_t first = m_expanded.size();
+			static_cast<const UsbElementRun*>(pElement)->Expand(m_expanded);
+			m_output.insert(m_output.end(), m_expanded.begin() + first, m_expanded.end());
+		}
+		else
+		{
+			m_output.push_back(pElement);
+		}
+	}
+
+	if(!m_output.empty())
+	{
+		SendToNextSink(&m_output[0], m_output.size());
+	}
+
+	m_output.clear();
+	ReleaseExpanded();
+}
+
+void UsbElementRunExpander::FinalizeElementSink()
+{
+}
+
+void UsbElementRunExpander::ReleaseExpanded()
+{
+	for(container_usb_element::iterator it=m_expanded.begin(); it!=m_expanded.end(); ++it)
+	{
+		(*it)->Release();
+	}
+
+	m_expanded.clear();
+}
+
+}
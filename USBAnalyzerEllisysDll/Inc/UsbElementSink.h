@@ -50,6 +50,49 @@ public:
 	virtual void FinalizeElementSink() = 0;
 };
 
+/// @brief
+/// 	Receives batches of USB elements.
+/// @remarks
+/// 	An USB element sink implements this interface in addition to 
+/// 	IUsbElementSink to receive a whole batch with a single virtual call.
+/// 	The producers of batches find the interface with dynamic_cast, so the
+/// 	run-time type information must be enabled (the default). A sink not 
+/// 	implementing it receives the elements of a batch one by one with 
+/// 	IUsbElementSink::OnElementArrival.
+/// @seealso
+/// 	IUsbElementSink, ChainableUsbElementSink::SendToNextSink, UsbElementsContainerInjector::InjectBatches
+class IUsbElementBatchSink
+{
+public:
+	/// @brief
+	/// 	Receives a batch of USB elements.
+	/// @remarks
+	/// 	The elements are received in their order in the batch. The batch 
+	/// 	is only valid during the call: a sink keeping an element must add
+	/// 	a reference to it, like with IUsbElementSink::OnElementArrival.
+	/// @param
+	/// 	ppElements - The received USB elements.
+	/// @param
+	/// 	count - The count of elements in the batch.
+	/// @seealso
+	/// 	IUsbElementSink::OnElementArrival
+	virtual void OnElementsArrival(UsbElement* const* ppElements, size_t count) = 0;
+
+public:
+	/// @brief
+	/// 	Sends a batch of USB elements to a sink.
+	/// @remarks
+	/// 	The batch is sent with a single call if the sink implements 
+	/// 	IUsbElementBatchSink, element by element otherwise.
+	/// @param
+	/// 	pElementSink - The element sink.
+	/// @param
+	/// 	ppElements - The elements to send.
+	/// @param
+	/// 	count - The count of elements in the batch.
+	inline static void SendElements(IUsbElementSink* pElementSink, UsbElement* const* ppElements, size_t count);
+};
+
 /// @brief
 /// 	An USB element sink that can be chained with other USB element sinks.
 /// @remarks
@@ -112,6 +155,16 @@ protected:
 	/// 	IsLastSink, SetNextSink
 	inline void SendToNextSink(UsbElement* pElement);
 
+	/// @brief
+	/// 	Sends a batch of USB elements to the next sink, if available.
+	/// @param
+	/// 	ppElements - The elements to send to the next sink.
+	/// @param
+	/// 	count - The count of elements in the batch.
+	/// @seealso
+	/// 	IUsbElementBatchSink::SendElements
+	inline void SendToNextSink(UsbElement* const* ppElements, size_t count);
+
 	/// @brief
 	/// 	Determines if this sink is the last of the chain.
 	/// @seealso
@@ -186,6 +239,80 @@ public:
 	virtual void FinalizeElementSink();
 };
 
+/// @brief
+/// 	Base class for USB elements visitors.
+/// @remarks
+///		This class dispatches the generic USB elements to the specialized
+///		Process methods of the Derived class. The handlers are resolved at
+///		compile time with a switch on UsbElement::GetElementType, so they
+///		can be inlined and GetElementType is the only virtual call made per
+///		element, where UsbElementProcessor makes a second one to its virtual
+///		Process method.
+///
+///		The Derived class only defines the handlers it needs, the other
+///		elements are ignored. The handlers must be accessible from this class,
+///		either public or with UsbElementVisitor<Derived> declared as friend.
+///
+///		Every element is sent to the next sink once its handler returns, the
+///		handlers do not send it themselves. A Derived class filtering or
+///		replacing elements overrides OnElementArrival and OnElementsArrival
+///		and calls Dispatch and SendToNextSink itself.
+///
+///		A batch of elements is dispatched in a single loop, with no virtual
+///		call between its elements, then sent to the next sink as a batch.
+/// @seealso
+/// 	UsbElementProcessor, UsbElement::GetElementType
+/// @sample
+/// \code
+/// class NakCounter : public usbdk::UsbElementVisitor<NakCounter>
+/// {
+/// public:
+///     size_t m_nakCount;
+/// 
+///     virtual void InitializeElementSink() { m_nakCount = 0; }
+///     virtual void FinalizeElementSink() {}
+/// 
+///     void ProcessTransaction(usbdk::UsbTransaction* pTransaction)
+///     {
+///         if(pTransaction->GetHandshakePacket().GetPID() == usbdk::pidNAK)
+///         {
+///             ++m_nakCount;
+///         }
+///     }
+/// };
+/// \endcode
+template<class Derived>
+class UsbElementVisitor : public ChainableUsbElementSink, public IUsbElementBatchSink
+{
+public:
+	virtual void InitializeElementSink() = 0;
+	inline virtual void OnElementArrival(UsbElement* pElement);
+	inline virtual void OnElementsArrival(UsbElement* const* ppElements, size_t count);
+	virtual void FinalizeElementSink() = 0;
+
+public:
+	/// @brief
+	/// 	Dispatches an USB element to the handler of its type.
+	/// @param
+	/// 	pElement - The element to dispatch.
+	inline void Dispatch(UsbElement* pElement);
+
+protected:
+	// Default handlers, hidden by the handlers of the Derived class
+	void ProcessInvalidPacket(UsbInvalidPacket*) {}
+	void ProcessStartOfFrame(UsbStartOfFrame*) {}
+	void ProcessTransaction(UsbTransaction*) {}
+	void ProcessSplitTransaction(UsbSplitTransaction*) {}
+	void ProcessLpmTransaction(UsbLpmTransaction*) {}
+	void ProcessReset(UsbReset*) {}
+	void ProcessSuspended(UsbSuspended*) {}
+	void ProcessKeepAlive(UsbKeepAlive*) {}
+	void ProcessPowerChange(UsbPowerChange*) {}
+	void ProcessHighSpeedHandshake(UsbHighSpeedHandshake*) {}
+	void ProcessTrigger(UsbTrigger*) {}
+	void ProcessUnknownElement(UsbElement*) {}
+};
+
 /// @brief
 /// 	Base class for USB elements processors.
 /// @remarks
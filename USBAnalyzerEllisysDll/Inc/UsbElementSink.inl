@@ -16,6 +16,29 @@
 
 namespace usbdk
 {
+//---------------------------------------------------------------
+// IUsbElementBatchSink
+//---------------------------------------------------------------
+
+void IUsbElementBatchSink::SendElements(IUsbElementSink* pElementSink, UsbElement* const* ppElements, size_t count)
+{
+	IUsbElementBatchSink* pBatchSink = dynamic_cast<IUsbElementBatchSink*>(pElementSink);
+
+	if(pBatchSink != NULL)
+	{
+		pBatchSink->OnElementsArrival(ppElements, count);
+		return;
+	}
+
+	for(size_t i=0; i<count; ++i)
+	{
+		pElementSink->OnElementArrival(ppElements[i]);
+	}
+}
+
+//---------------------------------------------------------------
+// ChainableUsbElementSink
+//---------------------------------------------------------------
 
 void ChainableUsbElementSink::SetNextSink(IUsbElementSink* pNextSink)
 {
@@ -40,9 +63,97 @@ void ChainableUsbElementSink::SendToNextSink(UsbElement* pElement)
 	}
 }
 
+void ChainableUsbElementSink::SendToNextSink(UsbElement* const* ppElements, size_t count)
+{
+	if((m_pNextSink != NULL) && (count != 0))
+	{
+		IUsbElementBatchSink::SendElements(m_pNextSink, ppElements, count);
+	}
+}
+
 bool ChainableUsbElementSink::IsLastSink() const
 {
 	return (m_pNextSink == NULL);
 }
 
+//---------------------------------------------------------------
+// UsbElementVisitor
+//---------------------------------------------------------------
+
+template<class Derived>
+void UsbElementVisitor<Derived>::OnElementArrival(UsbElement* pElement)
+{
+	Dispatch(pElement);
+	SendToNextSink(pElement);
+}
+
+template<class Derived>
+void UsbElementVisitor<Derived>::OnElementsArrival(UsbElement* const* ppElements, size_t count)
+{
+	for(size_t i=0; i<count; ++i)
+	{
+		Dispatch(ppElements[i]);
+	}
+
+	SendToNextSink(ppElements, count);
+}
+
+template<class Derived>
+void UsbElementVisitor<Derived>::Dispatch(UsbElement* pElement)
+{
+	Derived* pDerived = static_cast<Derived*>(this);
+
+	C_ASSERT(elementCount == 11);
+	switch(pElement->GetElementType())
+	{
+	case elementInvalidPacket:
+		pDerived->ProcessInvalidPacket(static_cast<UsbInvalidPacket*>(pElement));
+		break;
+
+	case elementStartOfFrame:
+		pDerived->ProcessStartOfFrame(static_cast<UsbStartOfFrame*>(pElement));
+		break;
+
+	case elementTransaction:
+		pDerived->ProcessTransaction(static_cast<UsbTransaction*>(pElement));
+		break;
+
+	case elementSplitTransaction:
+		pDerived->ProcessSplitTransaction(static_cast<UsbSplitTransaction*>(pElement));
+		break;
+
+	case elementLpmTransaction:
+		pDerived->ProcessLpmTransaction(static_cast<UsbLpmTransaction*>(pElement));
+		break;
+
+	case elementReset:
+		pDerived->ProcessReset(static_cast<UsbReset*>(pElement));
+		break;
+
+	case elementSuspended:
+		pDerived->ProcessSuspended(static_cast<UsbSuspended*>(pElement));
+		break;
+
+	case elementKeepAlive:
+		pDerived->ProcessKeepAlive(static_cast<UsbKeepAlive*>(pElement));
+		break;
+
+	case elementPowerChange:
+		pDerived->ProcessPowerChange(static_cast<UsbPowerChange*>(pElement));
+		break;
+
+	case elementHighSpeedHandshake:
+		pDerived->ProcessHighSpeedHandshake(static_cast<UsbHighSpeedHandshake*>(pElement));
+		break;
+
+	case elementTrigger:
+		pDerived->ProcessTrigger(static_cast<UsbTrigger*>(pElement));
+		break;
+
+	default:
+		pDerived->ProcessUnknownElement(pElement);
+		break;
+	}
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,284 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbElementSinkAsync.h
+/// @brief
+///		USB Analysis SDK asynchronous element sink declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/// @brief
+/// 	Specifies what is done with a new element when a queue is full.
+/// @seealso
+/// 	UsbElementSinkAsync::SetOverflowPolicy
+enum usb_overflow_policy
+{
+	overflowBlock,		///< Waits until the queue has a free slot
+	overflowDrop,		///< Drops the new element
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementQueue
+
+/// @brief
+/// 	Bounded queue of USB elements between two threads.
+/// @remarks
+/// 	The queue has a single producer thread, calling Push and TryPush, and
+/// 	a single consumer thread, calling Pop and TryPop. The capacity is rounded
+/// 	up to a power of two. No lock is taken while the queue is neither empty
+/// 	nor full, the threads only wait on an event otherwise.
+///
+/// 	The queue takes the reference of the pushed elements and gives it to
+/// 	the consumer. The elements still queued when the queue is destroyed
+/// 	are released.
+/// @seealso
+/// 	UsbElementSinkAsync
+class UsbElementQueue
+{
+private:
+	UsbElement** m_ppSlots;
+	size_t m_capacity;
+	DWORD m_mask;
+	volatile LONG m_head;
+	volatile LONG m_tail;
+	volatile LONG m_isClosed;
+	volatile LONG m_isConsumerWaiting;
+	volatile LONG m_isProducerWaiting;
+	HANDLE m_hNotEmptyEvent;
+	HANDLE m_hNotFullEvent;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementQueue object.
+	/// @param
+	/// 	capacity - The count of elements of the queue, rounded up to a power of two.
+	/// @seealso
+	/// 	~UsbElementQueue()
+	inline explicit UsbElementQueue(size_t capacity);
+
+	/// @brief
+	/// 	Destroys a UsbElementQueue object.
+	/// @remarks
+	/// 	The queued elements are released.
+	/// @seealso
+	/// 	UsbElementQueue()
+	inline ~UsbElementQueue();
+
+public:
+	/// @brief
+	/// 	Gets the count of elements the queue can contain.
+	inline size_t GetCapacity() const;
+
+	/// @brief
+	/// 	Gets the count of elements in the queue.
+	/// @remarks
+	/// 	The value is only an estimate while the queue is used by other threads.
+	inline size_t GetCount() const;
+
+	/// @brief
+	/// 	Determines whether the queue is empty.
+	inline bool IsEmpty() const;
+
+	/// @brief
+	/// 	Determines whether the queue is full.
+	inline bool IsFull() const;
+
+public:
+	/// @brief
+	/// 	Adds an element to the queue if it is not full.
+	/// @param
+	/// 	pElement - The element to add. Its reference is taken by the queue.
+	/// @return
+	/// 	true if the element was added, false if the queue is full.
+	inline bool TryPush(UsbElement* pElement);
+
+	/// @brief
+	/// 	Adds an element to the queue, waiting for a free slot if it is full.
+	/// @param
+	/// 	pElement - The element to add. Its reference is taken by the queue.
+	inline void Push(UsbElement* pElement);
+
+	/// @brief
+	/// 	Removes the oldest element of the queue if it is not empty.
+	/// @param
+	/// 	pElement - Receives the element and its reference.
+	/// @return
+	/// 	true if an element was removed, false if the queue is empty.
+	inline bool TryPop(UsbElement*& pElement);
+
+	/// @brief
+	/// 	Removes the oldest element of the queue, waiting for an element if it is empty.
+	/// @param
+	/// 	pElement - Receives the element and its reference.
+	/// @return
+	/// 	true if an element was removed, false if the queue is empty and closed.
+	/// @seealso
+	/// 	Close
+	inline bool Pop(UsbElement*& pElement);
+
+	/// @brief
+	/// 	Indicates that no element will be pushed anymore.
+	/// @remarks
+	/// 	The consumer gets the remaining elements, then Pop returns false.
+	/// @seealso
+	/// 	Pop
+	inline void Close();
+
+private:
+	UsbElementQueue(const UsbElementQueue&);
+	UsbElementQueue& operator=(const UsbElementQueue&);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbElementSinkAsync
+
+/// @brief
+/// 	Forwards the USB elements to the next sink on a worker thread.
+/// @remarks
+/// 	OnElementArrival only adds the element to a bounded queue, so a slow
+/// 	sink following this one does not stall the thread of the analyzer.
+/// 	A worker thread, started by InitializeElementSink, sends the queued
+/// 	elements to the next sink in their arrival order.
+///
+/// 	When the queue is full, the overflow policy either blocks the analyzer
+/// 	thread until the worker frees a slot, or drops the new element.
+///
+/// 	FinalizeElementSink waits until the worker has sent all the queued
+/// 	elements to the next sink. The next sinks must be finalized after this
+/// 	one, which is the order of ChainableUsbElementSinkManager.
+///
+/// 	When the next sink throws an exception, the worker sends no more
+/// 	elements and the new elements are not queued anymore. The error is
+/// 	thrown again, only once, on the acquisition thread by
+/// 	FinalizeElementSink, like
+/// 	ParallelUsbElementSinkManager does: a std::exception as a
+/// 	std::runtime_error with the same message, and a std::tstring as a
+/// 	std::tstring.
+///
+/// 	The elements are referenced by two threads, so they must use the
+/// 	multi-threaded reference counting policy (the default).
+/// @seealso
+/// 	UsbElementQueue, usb_overflow_policy, usb_element_refcount_policy
+/// @sample
+/// \code
+/// usbdk::UsbElementSinkAsync asyncSink;
+/// asyncSink.SetCapacity(64*1024);
+/// asyncSink.SetOverflowPolicy(usbdk::overflowDrop);
+///
+/// sinkChainer.AddElementSink(&myFastStatistics);
+/// sinkChainer.AddElementSink(&asyncSink);
+/// sinkChainer.AddElementSink(&mySlowDisplayer);
+/// \endcode
+class UsbElementSinkAsync : public ChainableUsbElementSink
+{
+public:
+	/// Default capacity of the queue.
+	enum { defaultCapacity = 16*1024 };
+
+private:
+	/// Error thrown by the next sink.
+	enum sink_error
+	{
+		sinkErrorNone,
+		sinkErrorException,		///< std::exception
+		sinkErrorString,		///< std::tstring
+		sinkErrorUnknown,		///< Other type
+	};
+
+	size_t m_capacity;
+	usb_overflow_policy m_overflowPolicy;
+	size_t m_droppedCount;
+	UsbElementQueue* m_pQueue;
+	HANDLE m_hThread;
+	volatile LONG m_hasFailed;
+	bool m_isErrorThrown;
+	sink_error m_error;
+	std::string m_exceptionMessage;
+	std::tstring m_stringMessage;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbElementSinkAsync object.
+	/// @seealso
+	/// 	~UsbElementSinkAsync()
+	inline UsbElementSinkAsync();
+
+	/// @brief
+	/// 	Destroys a UsbElementSinkAsync object.
+	/// @remarks
+	/// 	The worker thread is stopped if the sink was not finalized.
+	/// @seealso
+	/// 	UsbElementSinkAsync()
+	inline virtual ~UsbElementSinkAsync();
+
+public:
+	/// @brief
+	/// 	Sets the count of elements of the queue.
+	/// @remarks
+	/// 	The capacity is rounded up to a power of two and used by the
+	/// 	next call to InitializeElementSink.
+	/// @seealso
+	/// 	GetCapacity
+	inline void SetCapacity(size_t capacity);
+
+	/// @brief
+	/// 	Gets the count of elements of the queue.
+	/// @seealso
+	/// 	SetCapacity
+	inline size_t GetCapacity() const;
+
+	/// @brief
+	/// 	Sets what is done with a new element when the queue is full.
+	/// @remarks
+	/// 	The default policy is overflowBlock.
+	/// @seealso
+	/// 	usb_overflow_policy, GetDroppedCount
+	inline void SetOverflowPolicy(usb_overflow_policy policy);
+
+	/// @brief
+	/// 	Gets what is done with a new element when the queue is full.
+	/// @seealso
+	/// 	SetOverflowPolicy
+	inline usb_overflow_policy GetOverflowPolicy() const;
+
+	/// @brief
+	/// 	Gets the count of elements dropped since the initialization of the sink.
+	/// @seealso
+	/// 	SetOverflowPolicy
+	inline size_t GetDroppedCount() const;
+
+	/// @brief
+	/// 	Gets the count of elements waiting to be sent to the next sink.
+	inline size_t GetQueuedCount() const;
+
+	/// @brief
+	/// 	Determines whether the next sink has thrown an exception.
+	inline bool HasFailed() const;
+
+public:
+	inline virtual void InitializeElementSink();
+	inline virtual void OnElementArrival(UsbElement* pElement);
+	inline virtual void FinalizeElementSink();
+
+private:
+	inline void StopWorker();
+	inline void ThrowError();
+	inline void RunWorker();
+	inline static DWORD WINAPI WorkerThreadProc(LPVOID pParameter);
+
+private:
+	UsbElementSinkAsync(const UsbElementSinkAsync&);
+	UsbElementSinkAsync& operator=(const UsbElementSinkAsync&);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbElementSinkAsync.inl"
@@ -0,0 +1,359 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbElementSinkAsync.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbElementQueue
+//---------------------------------------------------------------
+
+UsbElementQueue::UsbElementQueue(size_t capacity) :
+	m_ppSlots(NULL),
+	m_capacity(1),
+	m_head(0),
+	m_tail(0),
+	m_isClosed(0),
+	m_isConsumerWaiting(0),
+	m_isProducerWaiting(0),
+	m_hNotEmptyEvent(CreateEvent(NULL, FALSE, FALSE, NULL)),
+	m_hNotFullEvent(CreateEvent(NULL, FALSE, FALSE, NULL))
+{
+	while(m_capacity < capacity)
+	{
+		m_capacity <<= 1;
+	}
+
+	m_mask = (DWORD) (m_capacity - 1);
+	m_ppSlots = new UsbElement*[m_capacity];
+}
+
+UsbElementQueue::~UsbElementQueue()
+{
+	UsbElement* pElement;
+
+	while(TryPop(pElement))
+	{
+		pElement->Release();
+	}
+
+	delete[] m_ppSlots;
+
+	CloseHandle(m_hNotEmptyEvent);
+	CloseHandle(m_hNotFullEvent);
+}
+
+size_t UsbElementQueue::GetCapacity() const
+{
+	return m_capacity;
+}
+
+size_t UsbElementQueue::GetCount() const
+{
+	return (DWORD) m_tail - (DWORD) m_head;
+}
+
+bool UsbElementQueue::IsEmpty() const
+{
+	return (m_tail == m_head);
+}
+
+bool UsbElementQueue::IsFull() const
+{
+	return (GetCount() >= m_capacity);
+}
+
+bool UsbElementQueue::TryPush(UsbElement* pElement)
+{
+	const DWORD tail = (DWORD) m_tail;
+
+	if((tail - (DWORD) m_head) >= m_capacity)
+	{
+		return false;
+	}
+
+	m_ppSlots[tail & m_mask] = pElement;
+
+	// Full barrier: the consumer sees the element before the waiting flag is read
+	InterlockedExchange(&m_tail, (LONG) (tail + 1));
+
+	if((m_isConsumerWaiting != 0) && (InterlockedExchange(&m_isConsumerWaiting, 0) != 0))
+	{
+		SetEvent(m_hNotEmptyEvent);
+	}
+
+	return true;
+}
+
+void UsbElementQueue::Push(UsbElement* pElement)
+{
+	while(!TryPush(pElement))
+	{
+		InterlockedExchange(&m_isProducerWaiting, 1);
+
+		// The consumer may have freed a slot before the flag was set
+		if(!IsFull())
+		{
+			InterlockedExchange(&m_isProducerWaiting, 0);
+			continue;
+		}
+
+		WaitForSingleObject(m_hNotFullEvent, INFINITE);
+	}
+}
+
+bool UsbElementQueue::TryPop(UsbElement*& pElement)
+{
+	const DWORD head = (DWORD) m_head;
+
+	if(head == (DWORD) m_tail)
+	{
+		return false;
+	}
+
+	pElement = m_ppSlots[head & m_mask];
+
+	// Full barrier: the producer sees the free slot before the waiting flag is read
+	InterlockedExchange(&m_head, (LONG) (head + 1));
+
+	if((m_isProducerWaiting != 0) && (InterlockedExchange(&m_isProducerWaiting, 0) != 0))
+	{
+		SetEvent(m_hNotFullEvent);
+	}
+
+	return true;
+}
+
+bool UsbElementQueue::Pop(UsbElement*& pElement)
+{
+	while(!TryPop(pElement))
+	{
+		if(m_isClosed != 0)
+		{
+			// The last elements may have been pushed before the queue was closed
+			return TryPop(pElement);
+		}
+
+		InterlockedExchange(&m_isConsumerWaiting, 1);
+
+		// The producer may have pushed an element before the flag was set
+		if(!IsEmpty() || (m_isClosed != 0))
+		{
+			InterlockedExchange(&m_isConsumerWaiting, 0);
+			continue;
+		}
+
+		WaitForSingleObject(m_hNotEmptyEvent, INFINITE);
+	}
+
+	return true;
+}
+
+void UsbElementQueue::Close()
+{
+	InterlockedExchange(&m_isClosed, 1);
+	SetEvent(m_hNotEmptyEvent);
+}
+
+//---------------------------------------------------------------
+// UsbElementSinkAsync
+//---------------------------------------------------------------
+
+UsbElementSinkAsync::UsbElementSinkAsync() :
+	m_capacity(defaultCapacity),
+	m_overflowPolicy(overflowBlock),
+	m_droppedCount(0),
+	m_pQueue(NULL),
+	m_hThread(NULL),
+	m_hasFailed(0),
+	m_isErrorThrown(false),
+	m_error(sinkErrorNone)
+{
+}
+
+UsbElementSinkAsync::~UsbElementSinkAsync()
+{
+	StopWorker();
+	delete m_pQueue;
+}
+
+void UsbElementSinkAsync::SetCapacity(size_t capacity)
+{
+	m_capacity = capacity;
+}
+
+size_t UsbElementSinkAsync::GetCapacity() const
+{
+	return (m_pQueue != NULL) ? m_pQueue->GetCapacity() : m_capacity;
+}
+
+void UsbElementSinkAsync::SetOverflowPolicy(usb_overflow_policy policy)
+{
+	m_overflowPolicy = policy;
+}
+
+usb_overflow_policy UsbElementSinkAsync::GetOverflowPolicy() const
+{
+	return m_overflowPolicy;
+}
+
+size_t UsbElementSinkAsync::GetDroppedCount() const
+{
+	return m_droppedCount;
+}
+
+size_t UsbElementSinkAsync::GetQueuedCount() const
+{
+	return (m_pQueue != NULL) ? m_pQueue->GetCount() : 0;
+}
+
+bool UsbElementSinkAsync::HasFailed() const
+{
+	return (m_hasFailed != 0);
+}
+
+void UsbElementSinkAsync::InitializeElementSink()
+{
+	StopWorker();
+
+	delete m_pQueue;
+	m_pQueue = new UsbElementQueue(m_capacity);
+	m_droppedCount = 0;
+	m_hasFailed = 0;
+	m_isErrorThrown = false;
+	m_error = sinkErrorNone;
+	m_exceptionMessage.clear();
+	m_stringMessage.clear();
+
+	m_hThread = CreateThread(NULL, 0, WorkerThreadProc, this, 0, NULL);
+	ASSERT(m_hThread != NULL);
+}
+
+void UsbElementSinkAsync::OnElementArrival(UsbElement* pElement)
+{
+	if(m_hThread == NULL)
+	{
+		// Not initialized, nothing to decouple
+		SendToNextSink(pElement);
+		return;
+	}
+
+	if(m_hasFailed != 0)
+	{
+		// The next sink failed, the error is thrown by FinalizeElementSink
+		return;
+	}
+
+	pElement->AddRef();
+
+	if(m_overflowPolicy == overflowBlock)
+	{
+		m_pQueue->Push(pElement);
+	}
+	else if(!m_pQueue->TryPush(pElement))
+	{
+		pElement->Release();
+		++m_droppedCount;
+	}
+}
+
+void UsbElementSinkAsync::FinalizeElementSink()
+{
+	StopWorker();
+
+	if((m_hasFailed != 0) && !m_isErrorThrown)
+	{
+		ThrowError();
+	}
+}
+
+void UsbElementSinkAsync::StopWorker()
+{
+	if(m_hThread == NULL)
+	{
+		return;
+	}
+
+	// The worker sends the remaining elements before exiting
+	m_pQueue->Close();
+
+	WaitForSingleObject(m_hThread, INFINITE);
+	CloseHandle(m_hThread);
+	m_hThread = NULL;
+}
+
+void UsbElementSinkAsync::ThrowError()
+{
+	m_isErrorThrown = true;
+
+	switch(m_error)
+	{
+	case sinkErrorException:
+		throw std::runtime_error(m_exceptionMessage);
+
+	case sinkErrorString:
+		throw m_stringMessage;
+
+	default:
+		throw std::runtime_error("Unknown error in an USB element sink");
+	}
+}
+
+void UsbElementSinkAsync::RunWorker()
+{
+	UsbElement* pElement;
+
+	// After a failure, the queued elements are only released
+	while(m_pQueue->Pop(pElement))
+	{
+		if(m_hasFailed == 0)
+		{
+			try
+			{
+				SendToNextSink(pElement);
+			}
+			catch(std::exception& e)
+			{
+				m_error = sinkErrorException;
+				m_exceptionMessage = e.what();
+			}
+			catch(std::tstring& s)
+			{
+				m_error = sinkErrorString;
+				m_stringMessage = s;
+			}
+			catch(...)
+			{
+				m_error = sinkErrorUnknown;
+			}
+
+			if(m_error != sinkErrorNone)
+			{
+				// The error is set before the failure is visible to the acquisition thread
+				InterlockedExchange(&m_hasFailed, 1);
+			}
+		}
+
+		pElement->Release();
+	}
+}
+
+DWORD WINAPI UsbElementSinkAsync::WorkerThreadProc(LPVOID pParameter)
+{
+	static_cast<UsbElementSinkAsync*>(pParameter)->RunWorker();
+	return 0;
+}
+
+}
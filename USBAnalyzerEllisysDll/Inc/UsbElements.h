@@ -45,9 +45,11 @@ enum usb_element_type
 
 /// @brief
 /// 	Base class of USB elements.
+/// @remarks
+/// 	The reference counting policy of the elements is usb_element_refcount_policy.
 /// @seealso
-/// 	usb_element_type, UsbElement::GetElementType
-class UsbElement : public RefCount
+/// 	usb_element_type, UsbElement::GetElementType, usb_element_refcount_policy
+class UsbElement : public RefCountT<usb_element_refcount_policy>
 {
 public:
 	/// @brief
@@ -127,6 +129,15 @@ public:
 	/// @seealso
 	/// 	usb_time
 	virtual usb_time GetTime() const = 0;
+
+	/// @brief
+	/// 	Gets the absolute time of the USB element in ticks.
+	/// @remarks
+	/// 	This method converts the result of GetTime, so the ticks are not
+	/// 	more precise than the usb_time.
+	/// @seealso
+	/// 	usb_ticks, GetTime
+	inline usb_ticks GetTicks() const;
 };
 
 /// @brief
@@ -534,6 +545,15 @@ public:
 	/// 	unknown_endpoint_number, UsbPacketToken::GetEndpointNumber
 	inline usb_endpoint_number GetEndpointNumber() const;
 
+	/// @brief
+	/// 	Gets the time of the last packet of the USB transaction.
+	/// @return
+	/// 	The time of the handshake packet, or of the data packet, or of the 
+	/// 	token packet, whichever is the last not empty packet.
+	/// @seealso
+	/// 	UsbPacket::GetTicks
+	inline usb_ticks GetEndTicks() const;
+
 	/// @brief
 	/// 	Gets the errors of the USB transaction.
 	/// @return
@@ -809,6 +829,16 @@ public:
 	/// @seealso
 	/// 	unknown_endpoint_number, UsbPacketToken::GetEndpointNumber
 	inline usb_endpoint_number GetTokenEndpointNumber() const;
+
+	/// @brief
+	/// 	Gets the time of the last packet of the USB split transaction.
+	/// @return
+	/// 	The time of the handshake packet, or of the data packet, or of the 
+	/// 	token packet, or of the split packet, whichever is the last not
+	/// 	empty packet.
+	/// @seealso
+	/// 	UsbPacket::GetTicks
+	inline usb_ticks GetEndTicks() const;
 };
 
 //---------------------------------------------------------------
@@ -16,6 +16,15 @@
 
 namespace usbdk
 {
+//---------------------------------------------------------------
+// UsbElement
+//---------------------------------------------------------------
+
+usb_ticks UsbElement::GetTicks() const
+{
+	return UsbTimeToTicks(GetTime());
+}
+
 //---------------------------------------------------------------
 // UsbStartOfFrame
 //---------------------------------------------------------------
@@ -152,6 +161,13 @@ usb_endpoint_number UsbTransaction::GetEndpointNumber() const
 	return GetTokenPacket().GetEndpointNumber();
 }
 
+usb_ticks UsbTransaction::GetEndTicks() const
+{
+	if(!m_handshake.IsEmpty()) return m_handshake.GetTicks();
+	if(!m_data.IsEmpty()) return m_data.GetTicks();
+	return m_token.GetTicks();
+}
+
 bool UsbTransaction::IsValid() const
 {
 	return (GetErrors() == errorTransactionNothing);
@@ -252,6 +268,14 @@ usb_endpoint_address UsbSplitTransaction::GetTokenEndpointNumber() const
 	return GetTokenPacket().GetEndpointNumber();
 }
 
+usb_ticks UsbSplitTransaction::GetEndTicks() const
+{
+	if(!m_handshake.IsEmpty()) return m_handshake.GetTicks();
+	if(!m_data.IsEmpty()) return m_data.GetTicks();
+	if(!m_token.IsEmpty()) return m_token.GetTicks();
+	return m_split.GetTicks();
+}
+
 usb_device_address UsbSplitTransaction::GetSplitHubAddress() const
 {
 	return GetSplitPacket().GetHubAddress();
@@ -31,3 +31,22 @@ bool IsTimeReferenceReset();
 void ResetTimeReference();
 usbdk::usb_time GetTimeReference();
 void SetTimeReference(usbdk::usb_time referenceTime);
+
+// Formats a time in ticks as seconds with its 12 digits of picoseconds. The digits are
+// computed with integers, so two times one tick apart are never formatted alike.
+inline std::tstring FormatTicks(usbdk::usb_ticks ticks)
+{
+	if(ticks == usbdk::unknown_ticks)
+	{
+		return _T("Unknown");
+	}
+
+	const bool isNegative = (ticks < 0);
+	const DWORDLONG absoluteTicks = isNegative ? (DWORDLONG) -ticks : (DWORDLONG) ticks;
+	const DWORDLONG ticksPerSecond = (DWORDLONG) usbdk::usb_ticks_per_second;
+
+	TCHAR text[32];
+	_stprintf_s(text, countof(text), _T("%s%I64u.%012I64u"), isNegative ? _T("-") : _T(""), absoluteTicks / ticksPerSecond, absoluteTicks % ticksPerSecond);
+
+	return text;
+}
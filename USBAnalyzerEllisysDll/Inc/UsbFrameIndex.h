@@ -0,0 +1,205 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbFrameIndex.h
+/// @brief
+///		USB Analysis SDK Start-of-Frame index declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/// @brief
+///		Specifies why a new epoch of frames began.
+/// @seealso
+///		UsbFrameIndex::GetEpochCause
+enum usb_frame_epoch_cause
+{
+	epochCauseFirst,			///< First Start-of-Frame of the analysis
+	epochCauseWraparound,		///< The frame number wrapped around after max_frame_number
+	epochCauseReset,			///< A reset occurred since the previous Start-of-Frame
+	epochCauseNonConsecutive,	///< The Start-of-Frame does not follow the previous one
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbFrameIndex
+
+/// @brief
+/// 	Indexes the Start-of-Frames of the elements while they are stored.
+/// @remarks
+/// 	The position of an element is its index among the elements received
+/// 	since InitializeElementSink. When the index is chained with a
+/// 	UsbElementSinkStorage not using the circular buffer mode, the position
+/// 	is the index of the element in the container.
+///
+/// 	The Start-of-Frames are gathered in epochs of consecutive frames. A new
+/// 	epoch begins when the frame number wraps around, after a reset, or when
+/// 	a Start-of-Frame is flagged as non-consecutive or does not follow the
+/// 	previous one, like after a corrupted Start-of-Frame which is not indexed.
+/// 	A frame is found in constant time from its epoch, frame number and
+/// 	micro-frame number, and a time is found by a binary search.
+///
+/// 	Each Start-of-Frame costs a position and a time in the index. The index
+/// 	must not be read while the elements arrive.
+/// @seealso
+/// 	UsbElementSinkStorage, UsbStartOfFrame
+/// @sample
+/// \code
+/// usbdk::UsbFrameIndex frameIndex;
+///
+/// usbdk::ChainableUsbElementSinkManager sinkChainer;
+/// sinkChainer.AddElementSink(&frameIndex);
+/// sinkChainer.AddElementSink(&storage);
+/// pAnalyzer->BeginAcquisition(&sinkChainer);
+/// ...
+/// size_t position;
+/// if(frameIndex.FindFramePosition(2, 1234, 0, position))
+/// {
+///     ShowElement(elements[position]);
+/// }
+///
+/// if(frameIndex.FindTimePosition(12.5, position))
+/// {
+///     ShowElement(elements[position]);
+/// }
+/// \endcode
+class UsbFrameIndex : public UsbElementVisitor<UsbFrameIndex>
+{
+	friend class UsbElementVisitor<UsbFrameIndex>;
+
+private:
+	struct frame_entry
+	{
+		size_t position;
+		usb_ticks ticks;
+	};
+
+	struct frame_epoch
+	{
+		size_t firstEntry;
+		DWORD firstSequence;
+		DWORD sequenceStep;
+		usb_frame_epoch_cause cause;
+	};
+
+	std::vector<frame_entry> m_entries;
+	std::vector<frame_epoch> m_epochs;
+	size_t m_position;
+	DWORD m_lastSequence;
+	bool m_isResetPending;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbFrameIndex object.
+	/// @seealso
+	/// 	~UsbFrameIndex()
+	inline UsbFrameIndex();
+
+	/// @brief
+	/// 	Destroys a UsbFrameIndex object.
+	/// @seealso
+	/// 	UsbFrameIndex()
+	inline virtual ~UsbFrameIndex();
+
+public:
+	/// @brief
+	/// 	Gets the count of indexed Start-of-Frames.
+	inline size_t GetFrameCount() const;
+
+	/// @brief
+	/// 	Gets the position of an indexed Start-of-Frame.
+	/// @param
+	/// 	index - The index of the Start-of-Frame, lower than GetFrameCount.
+	inline size_t GetFramePosition(size_t index) const;
+
+	/// @brief
+	/// 	Gets the time of an indexed Start-of-Frame.
+	/// @param
+	/// 	index - The index of the Start-of-Frame, lower than GetFrameCount.
+	inline usb_ticks GetFrameTicks(size_t index) const;
+
+	/// @brief
+	/// 	Gets the count of epochs.
+	inline size_t GetEpochCount() const;
+
+	/// @brief
+	/// 	Gets why an epoch began.
+	/// @param
+	/// 	epoch - The epoch, lower than GetEpochCount.
+	inline usb_frame_epoch_cause GetEpochCause(size_t epoch) const;
+
+	/// @brief
+	/// 	Gets the index of the first Start-of-Frame of an epoch.
+	/// @param
+	/// 	epoch - The epoch, lower than GetEpochCount.
+	inline size_t GetEpochFirstFrame(size_t epoch) const;
+
+	/// @brief
+	/// 	Gets the count of Start-of-Frames of an epoch.
+	/// @param
+	/// 	epoch - The epoch, lower than GetEpochCount.
+	inline size_t GetEpochFrameCount(size_t epoch) const;
+
+	/// @brief
+	/// 	Finds the position of a Start-of-Frame.
+	/// @param
+	/// 	epoch - The epoch of the Start-of-Frame.
+	/// @param
+	/// 	frameNumber - The frame number of the Start-of-Frame.
+	/// @param
+	/// 	microFrameNumber - The micro-frame number of the Start-of-Frame, or
+	/// 	0 for the full speed frames.
+	/// @param
+	/// 	position - Receives the position of the Start-of-Frame.
+	/// @return
+	/// 	true if the Start-of-Frame is found.
+	inline bool FindFramePosition(size_t epoch, usb_frame_number frameNumber, usb_microframe_number microFrameNumber, size_t& position) const;
+
+	/// @brief
+	/// 	Finds the position of the last Start-of-Frame at or before a time.
+	/// @param
+	/// 	ticks - The time.
+	/// @param
+	/// 	position - Receives the position of the Start-of-Frame.
+	/// @return
+	/// 	true if the Start-of-Frame is found, false if the time is before the
+	/// 	first Start-of-Frame.
+	inline bool FindTicksPosition(usb_ticks ticks, size_t& position) const;
+
+	/// @brief
+	/// 	Finds the position of the last Start-of-Frame at or before a time.
+	/// @param
+	/// 	time - The time.
+	/// @param
+	/// 	position - Receives the position of the Start-of-Frame.
+	/// @return
+	/// 	true if the Start-of-Frame is found, false if the time is before the
+	/// 	first Start-of-Frame.
+	inline bool FindTimePosition(usb_time time, size_t& position) const;
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	The index is cleared. A derived class overriding this method must
+	/// 	call it.
+	inline virtual void InitializeElementSink();
+
+	inline virtual void OnElementArrival(UsbElement* pElement);
+	inline virtual void OnElementsArrival(UsbElement* const* ppElements, size_t count);
+	inline virtual void FinalizeElementSink();
+
+protected:
+	inline void ProcessStartOfFrame(UsbStartOfFrame* pStartOfFrame);
+	inline void ProcessReset(UsbReset* pReset);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbFrameIndex.inl"
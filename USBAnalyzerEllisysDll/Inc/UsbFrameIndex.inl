@@ -0,0 +1,227 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbFrameIndex.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbFrameIndex
+//---------------------------------------------------------------
+
+UsbFrameIndex::UsbFrameIndex() :
+	m_position(0),
+	m_lastSequence(0),
+	m_isResetPending(false)
+{
+}
+
+UsbFrameIndex::~UsbFrameIndex()
+{
+}
+
+size_t UsbFrameIndex::GetFrameCount() const
+{
+	return m_entries.size();
+}
+
+size_t UsbFrameIndex::GetFramePosition(size_t index) const
+{
+	return m_entries[index].position;
+}
+
+usb_ticks UsbFrameIndex::GetFrameTicks(size_t index) const
+{
+	return m_entries[index].ticks;
+}
+
+size_t UsbFrameIndex::GetEpochCount() const
+{
+	return m_epochs.size();
+}
+
+usb_frame_epoch_cause UsbFrameIndex::GetEpochCause(size_t epoch) const
+{
+	return m_epochs[epoch].cause;
+}
+
+size_t UsbFrameIndex::GetEpochFirstFrame(size_t epoch) const
+{
+	return m_epochs[epoch].firstEntry;
+}
+
+size_t UsbFrameIndex::GetEpochFrameCount(size_t epoch) const
+{
+	const size_t endEntry = (epoch + 1 < m_epochs.size()) ? m_epochs[epoch + 1].firstEntry : m_entries.size();
+	return endEntry - m_epochs[epoch].firstEntry;
+}
+
+bool UsbFrameIndex::FindFramePosition(size_t epoch, usb_frame_number frameNumber, usb_microframe_number microFrameNumber, size_t& position) const
+{
+	if((epoch >= m_epochs.size()) || (frameNumber > max_frame_number) || (microFrameNumber > max_microframe_number))
+	{
+		return false;
+	}
+
+	const frame_epoch& frameEpoch = m_epochs[epoch];
+	const DWORD sequence = (DWORD) frameNumber * (max_microframe_number + 1) + microFrameNumber;
+
+	if((sequence < frameEpoch.firstSequence) || (((sequence - frameEpoch.firstSequence) % frameEpoch.sequenceStep) != 0))
+	{
+		return false;
+	}
+
+	// The frames of an epoch are consecutive, their index is computed
+	const size_t offset = (sequence - frameEpoch.firstSequence) / frameEpoch.sequenceStep;
+
+	if(offset >= GetEpochFrameCount(epoch))
+	{
+		return false;
+	}
+
+	position = m_entries[frameEpoch.firstEntry + offset].position;
+	return true;
+}
+
+bool UsbFrameIndex::FindTicksPosition(usb_ticks ticks, size_t& position) const
+{
+	// Binary search of the first Start-of-Frame after the time
+	size_t first = 0;
+	size_t count = m_entries.size();
+
+	while(count > 0)
+	{
+		const size_t half = count / 2;
+
+		if(m_entries[first + half].ticks <= ticks)
+		{
+			first += half + 1;
+			count -= half + 1;
+		}
+		else
+		{
+			count = half;
+		}
+	}
+
+	if(first == 0)
+	{
+		return false;
+	}
+
+	position = m_entries[first - 1].position;
+	return true;
+}
+
+bool UsbFrameIndex::FindTimePosition(usb_time time, size_t& position) const
+{
+	return FindTicksPosition(UsbTimeToTicks(time), position);
+}
+
+void UsbFrameIndex::InitializeElementSink()
+{
+	m_entries.clear();
+	m_epochs.clear();
+	m_position = 0;
+	m_lastSequence = 0;
+	m_isResetPending = false;
+}
+
+void UsbFrameIndex::OnElementArrival(UsbElement* pElement)
+{
+	Dispatch(pElement);
+	++m_position;
+
+	SendToNextSink(pElement);
+}
+
+void UsbFrameIndex::OnElementsArrival(UsbElement* const* ppElements, size_t count)
+{
+	for(size_t i=0; i<count; ++i)
+	{
+		Dispatch(ppElements[i]);
+		++m_position;
+	}
+
+	SendToNextSink(ppElements, count);
+}
+
+void UsbFrameIndex::FinalizeElementSink()
+{
+}
+
+void UsbFrameIndex::ProcessStartOfFrame(UsbStartOfFrame* pStartOfFrame)
+{
+	const usb_frame_number frameNumber = pStartOfFrame->GetFrameNumber();
+
+	if(!pStartOfFrame->IsValid() || (frameNumber > max_frame_number))
+	{
+		return;
+	}
+
+	// The full speed frames have no micro-frame, they follow each other by 8 micro-frames
+	const usb_microframe_number microFrameNumber = pStartOfFrame->GetMicroFrameNumber();
+	const bool hasMicroFrame = (microFrameNumber <= max_microframe_number);
+	const DWORD sequenceStep = hasMicroFrame ? 1 : (max_microframe_number + 1);
+	const DWORD sequence = (DWORD) frameNumber * (max_microframe_number + 1) + (hasMicroFrame ? microFrameNumber : 0);
+
+	bool isNewEpoch = true;
+	usb_frame_epoch_cause cause = epochCauseNonConsecutive;
+
+	if(m_epochs.empty())
+	{
+		cause = epochCauseFirst;
+	}
+	else if(m_isResetPending)
+	{
+		cause = epochCauseReset;
+	}
+	else if(!pStartOfFrame->GetNonConsecutive() && (sequenceStep == m_epochs.back().sequenceStep))
+	{
+		if(sequence == m_lastSequence + sequenceStep)
+		{
+			isNewEpoch = false;
+		}
+		else if((sequence == 0) && (m_lastSequence + sequenceStep == max_frame_count * (max_microframe_number + 1)))
+		{
+			cause = epochCauseWraparound;
+		}
+	}
+
+	if(isNewEpoch)
+	{
+		frame_epoch epoch;
+		epoch.firstEntry = m_entries.size();
+		epoch.firstSequence = sequence;
+		epoch.sequenceStep = sequenceStep;
+		epoch.cause = cause;
+
+		m_epochs.push_back(epoch);
+	}
+
+	frame_entry entry;
+	entry.position = m_position;
+	entry.ticks = pStartOfFrame->GetTicks();
+
+	m_entries.push_back(entry);
+	m_lastSequence = sequence;
+	m_isResetPending = false;
+}
+
+void UsbFrameIndex::ProcessReset(UsbReset*)
+{
+	m_isResetPending = true;
+}
+
+}
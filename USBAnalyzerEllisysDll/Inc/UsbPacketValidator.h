@@ -0,0 +1,138 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbPacketValidator.h
+/// @brief
+///		USB Analysis SDK batch packet validation declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/// @brief
+///		Raw data of a USB packet to validate.
+/// @seealso
+///		UsbPacketValidator
+struct usb_packet_span
+{
+	/// Raw data of the packet, the PID and the packet fields.
+	const BYTE* pRawData;
+
+	/// Size of the raw data in bytes.
+	size_t rawDataSize;
+
+	/// true if the packet is an extended token packet, starting with a SubPID.
+	bool isExtTokenPacket;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// UsbPacketValidator
+
+/// @brief
+/// 	Computes the errors of many USB packets in one call.
+/// @remarks
+/// 	The packets are validated in two passes. The first pass checks the
+/// 	PID and the length of each packet, and sorts the packets to check by
+/// 	CRC: the Start-of-Frame, token and extended token packets share the
+/// 	CRC-5 of 11 bits, the split packets have the CRC-5 of 19 bits and the
+/// 	data packets the CRC-16. The second pass checks each group in its own
+/// 	loop, without any dispatch on the packet type, so an offline
+/// 	validation of a capture spends its time in the CRC tables.
+///
+/// 	Only these rules are checked. The PID must be one of usb_pid, and the
+/// 	SubPID of an extended token packet must have its high bits
+/// 	complementing its low bits, else errorPacketInvalidPID is set. The
+/// 	Start-of-Frame and handshake packets must have their exact size, the
+/// 	data packets must hold at least a PID and a CRC-16, and no packet may
+/// 	be longer than its type allows, else errorPacketInvalidRawDataLength
+/// 	is set. A token, extended token or split packet too short for its
+/// 	fields gets the flags of the missing fields, like
+/// 	errorPacketTokenMissingCrc5. The CRC of a complete packet must match
+/// 	its content, else errorPacketInvalidCRC is set.
+///
+/// 	These rules follow the ones of UsbPacket::GetErrors, but the validator
+/// 	does not call it and its results are not compared with it. The groups
+/// 	are kept between the calls, so a validator validating many batches
+/// 	does not allocate memory once its groups are large enough.
+/// @seealso
+/// 	usb_packet_span, UsbPacket::GetErrors
+/// @sample
+/// \code
+/// usbdk::UsbPacketValidator validator;
+/// std::vector<usbdk::usb_packet_errors> errors(packets.size());
+/// validator.Validate(&packets[0], packets.size(), &errors[0]);
+/// \endcode
+class UsbPacketValidator
+{
+private:
+	// The fields following the PID, the CRC-5 included
+	struct crc5_entry
+	{
+		DWORD fields;
+		size_t index;
+	};
+
+	struct crc16_entry
+	{
+		const BYTE* pRawData;
+		size_t rawDataSize;
+		size_t index;
+	};
+
+	std::vector<crc5_entry> m_crc5Of11Bits;
+	std::vector<crc5_entry> m_crc5Of19Bits;
+	std::vector<crc16_entry> m_crc16;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbPacketValidator object.
+	/// @seealso
+	/// 	~UsbPacketValidator()
+	inline UsbPacketValidator();
+
+	/// @brief
+	/// 	Destroys a UsbPacketValidator object.
+	/// @seealso
+	/// 	UsbPacketValidator()
+	inline ~UsbPacketValidator();
+
+public:
+	/// @brief
+	/// 	Computes the errors of USB packets.
+	/// @param
+	/// 	ppPackets - The packets.
+	/// @param
+	/// 	count - The count of packets.
+	/// @param
+	/// 	pErrors - Receives the errors of each packet.
+	inline void Validate(const UsbPacket* const* ppPackets, size_t count, usb_packet_errors* pErrors);
+
+	/// @brief
+	/// 	Computes the errors of USB packets given by their raw data.
+	/// @param
+	/// 	pSpans - The raw data of the packets.
+	/// @param
+	/// 	count - The count of packets.
+	/// @param
+	/// 	pErrors - Receives the errors of each packet.
+	inline void Validate(const usb_packet_span* pSpans, size_t count, usb_packet_errors* pErrors);
+
+private:
+	inline void Clear();
+	inline usb_packet_errors Classify(const BYTE* pRawData, size_t rawDataSize, bool isExtTokenPacket, size_t index);
+	inline void CheckCRCs(usb_packet_errors* pErrors) const;
+
+private:
+	UsbPacketValidator(const UsbPacketValidator&);
+	UsbPacketValidator& operator=(const UsbPacketValidator&);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbPacketValidator.inl"
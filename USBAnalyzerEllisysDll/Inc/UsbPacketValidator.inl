@@ -0,0 +1,221 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbPacketValidator.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbPacketValidator
+//---------------------------------------------------------------
+
+UsbPacketValidator::UsbPacketValidator()
+{
+}
+
+UsbPacketValidator::~UsbPacketValidator()
+{
+}
+
+void UsbPacketValidator::Validate(const UsbPacket* const* ppPackets, size_t count, usb_packet_errors* pErrors)
+{
+	Clear();
+
+	for(size_t i=0; i<count; ++i)
+	{
+		const UsbPacket::TContainer& rawData = ppPackets[i]->GetRawData();
+		pErrors[i] = Classify(rawData.empty() ? NULL : &rawData[0], rawData.size(), ppPackets[i]->IsExtTokenPacket(), i);
+	}
+
+	CheckCRCs(pErrors);
+}
+
+void UsbPacketValidator::Validate(const usb_packet_span* pSpans, size_t count, usb_packet_errors* pErrors)
+{
+	Clear();
+
+	for(size_t i=0; i<count; ++i)
+	{
+		pErrors[i] = Classify(pSpans[i].pRawData, pSpans[i].rawDataSize, pSpans[i].isExtTokenPacket, i);
+	}
+
+	CheckCRCs(pErrors);
+}
+
+void UsbPacketValidator::Clear()
+{
+	m_crc5Of11Bits.clear();
+	m_crc5Of19Bits.clear();
+	m_crc16.clear();
+}
+
+usb_packet_errors UsbPacketValidator::Classify(const BYTE* pRawData, size_t rawDataSize, bool isExtTokenPacket, size_t index)
+{
+	if(rawDataSize == 0)
+	{
+		return errorPacketInvalidRawDataLength;
+	}
+
+	usb_packet_type packetType;
+
+	if(isExtTokenPacket)
+	{
+		// The SubPID is checked like a PID, its high bits complement its low bits
+		if(((pRawData[0] ^ (pRawData[0] >> 4)) & 0x0F) != 0x0F)
+		{
+			return errorPacketInvalidPID;
+		}
+
+		packetType = packetExtToken;
+	}
+	else
+	{
+		packetType = UsbPacket::GetPacketType((usb_pid) pRawData[0]);
+	}
+
+	crc5_entry crc5;
+	crc5.index = index;
+
+	switch(packetType)
+	{
+	case packetStartOfFrame:
+		if(rawDataSize != packetSizeStartOfFrame)
+		{
+			return errorPacketInvalidRawDataLength;
+		}
+
+		crc5.fields = pRawData[1] | (pRawData[2] << 8);
+		m_crc5Of11Bits.push_back(crc5);
+		return errorPacketNothing;
+
+	case packetToken:
+		if(rawDataSize < 2)
+		{
+			return errorPacketTokenMissingAddrEndp | errorPacketTokenMissingCrc5;
+		}
+
+		if(rawDataSize < packetSizeToken)
+		{
+			return errorPacketTokenMissingCrc5;
+		}
+
+		if(rawDataSize > packetSizeToken)
+		{
+			return errorPacketInvalidRawDataLength;
+		}
+
+		crc5.fields = pRawData[1] | (pRawData[2] << 8);
+		m_crc5Of11Bits.push_back(crc5);
+		return errorPacketNothing;
+
+	case packetExtToken:
+		if(rawDataSize < 2)
+		{
+			return errorPacketExtTokenMissingPayload | errorPacketExtTokenMissingCrc5;
+		}
+
+		if(rawDataSize < packetSizeExtToken)
+		{
+			return errorPacketExtTokenMissingCrc5;
+		}
+
+		if(rawDataSize > packetSizeExtToken)
+		{
+			return errorPacketInvalidRawDataLength;
+		}
+
+		crc5.fields = pRawData[1] | (pRawData[2] << 8);
+		m_crc5Of11Bits.push_back(crc5);
+		return errorPacketNothing;
+
+	case packetSplit:
+		if(rawDataSize < 2)
+		{
+			return errorPacketSplitMissingHubAddrSC | errorPacketSplitMissingPortS | errorPacketSplitMissingEEtCrc5;
+		}
+
+		if(rawDataSize < 3)
+		{
+			return errorPacketSplitMissingPortS | errorPacketSplitMissingEEtCrc5;
+		}
+
+		if(rawDataSize < packetSizeSplit)
+		{
+			return errorPacketSplitMissingEEtCrc5;
+		}
+
+		if(rawDataSize > packetSizeSplit)
+		{
+			return errorPacketInvalidRawDataLength;
+		}
+
+		crc5.fields = pRawData[1] | (pRawData[2] << 8) | ((DWORD) pRawData[3] << 16);
+		m_crc5Of19Bits.push_back(crc5);
+		return errorPacketNothing;
+
+	case packetData:
+		{
+			if(rawDataSize < packetSizeData)
+			{
+				return errorPacketInvalidRawDataLength;
+			}
+
+			const crc16_entry crc16 = { pRawData, rawDataSize, index };
+			m_crc16.push_back(crc16);
+		}
+		return errorPacketNothing;
+
+	case packetHandshake:
+		if(rawDataSize != packetSizeHandshake)
+		{
+			return errorPacketInvalidRawDataLength;
+		}
+
+		return errorPacketNothing;
+	}
+
+	return errorPacketInvalidPID;
+}
+
+void UsbPacketValidator::CheckCRCs(usb_packet_errors* pErrors) const
+{
+	// The CRC-5 field follows the 11 or 19 bits it covers
+	for(size_t i=0; i<m_crc5Of11Bits.size(); ++i)
+	{
+		const crc5_entry& entry = m_crc5Of11Bits[i];
+		const usb_crc5 crc = UsbCRC::ComputeUsbCRC5Of11Bits((WORD) entry.fields);
+
+		pErrors[entry.index] |= (crc != (entry.fields >> 11)) ? errorPacketInvalidCRC : errorPacketNothing;
+	}
+
+	for(size_t i=0; i<m_crc5Of19Bits.size(); ++i)
+	{
+		const crc5_entry& entry = m_crc5Of19Bits[i];
+		const usb_crc5 crc = UsbCRC::ComputeUsbCRC5Of19Bits(entry.fields);
+
+		pErrors[entry.index] |= (crc != (entry.fields >> 19)) ? errorPacketInvalidCRC : errorPacketNothing;
+	}
+
+	// The CRC-16 field follows the payload, least significant byte first
+	for(size_t i=0; i<m_crc16.size(); ++i)
+	{
+		const crc16_entry& entry = m_crc16[i];
+		const BYTE* pCrc = entry.pRawData + entry.rawDataSize - 2;
+		const usb_crc16 crc = UsbCRC::ComputeUsbCRC16(entry.pRawData + 1, pCrc);
+
+		pErrors[entry.index] |= (crc != (pCrc[0] | (pCrc[1] << 8))) ? errorPacketInvalidCRC : errorPacketNothing;
+	}
+}
+
+}
@@ -250,15 +250,35 @@ public:
 	/// @brief
 	///		Get the time of the USB packet.
 	/// @seealso
-	///		usb_time, SetTime
+	///		usb_time, SetTime, GetTicks
 	inline usb_time GetTime() const;
 
 	/// @brief
 	///		Set the time of the USB packet.
 	/// @seealso
-	///		usb_time, GetTime
+	///		usb_time, GetTime, SetTicks
 	inline void SetTime(usb_time time);
 
+	/// @brief
+	///		Get the time of the USB packet in ticks.
+	/// @remarks
+	///		The packet stores its time as a usb_time, a double, in the layout
+	///		of the library. This method converts it, so the ticks are not more
+	///		precise than the usb_time: below a picosecond during the first hour
+	///		of a capture, about 20 picoseconds after a day.
+	/// @seealso
+	///		usb_ticks, SetTicks, GetTime
+	inline usb_ticks GetTicks() const;
+
+	/// @brief
+	///		Set the time of the USB packet in ticks.
+	/// @remarks
+	///		The ticks are converted to the usb_time stored by the packet, so
+	///		GetTicks may return them rounded to the precision of the usb_time.
+	/// @seealso
+	///		usb_ticks, GetTicks, SetTime
+	inline void SetTicks(usb_ticks ticks);
+
 	/// @brief
 	///		Get the speed of the USB packet.
 	/// @seealso
@@ -472,6 +492,35 @@ public:
 	static TContainer PrepareRawData(usb_frame_number frameNumber, usb_crc5 crc5);
 };
 
+/// @brief
+///		Raw data of a USB Start-of-Frame packet prepared at compile time.
+/// @remarks
+///		The CRC-5 is computed by the compiler, so synthetic packets can be
+///		built from constant data without any computation.
+/// @seealso
+///		UsbPacketStartOfFrame::PrepareRawData
+/// @sample
+/// \code
+/// usbdk::UsbPacketStartOfFrame packet(usbdk::usb_start_of_frame_raw_data<1234>::value, usbdk::packetSizeStartOfFrame, time, usbdk::speedHigh);
+/// \endcode
+template<usb_frame_number FrameNumber>
+struct usb_start_of_frame_raw_data
+{
+	/// CRC5 field of the USB Start-of-Frame packet.
+	enum { crc5 = usb_crc5_entry<(FrameNumber & 0x07FF), 11>::value };
+
+	/// Raw data of the USB Start-of-Frame packet.
+	static const BYTE value[packetSizeStartOfFrame];
+};
+
+template<usb_frame_number FrameNumber>
+const BYTE usb_start_of_frame_raw_data<FrameNumber>::value[packetSizeStartOfFrame] =
+{
+	pidSOF,
+	(BYTE) FrameNumber,
+	(BYTE) (((FrameNumber >> 8) & 0x07) | (crc5 << 3)),
+};
+
 /// @brief
 ///		USB token packet.
 /// @remarks
@@ -594,6 +643,39 @@ public:
 	static TContainer PrepareRawData(usb_pid pid, usb_device_address deviceAddress, usb_endpoint_number endpointNumber, usb_crc5 crc5);
 };
 
+/// @brief
+///		Raw data of a USB token packet prepared at compile time.
+/// @remarks
+///		The CRC-5 is computed by the compiler, so synthetic packets can be
+///		built from constant data without any computation.
+/// @seealso
+///		UsbPacketToken::PrepareRawData
+/// @sample
+/// \code
+/// typedef usbdk::usb_token_raw_data<usbdk::pidIN, 5, 1> in_token;
+/// usbdk::UsbPacketToken packet(in_token::value, usbdk::packetSizeToken, time, usbdk::speedHigh);
+/// \endcode
+template<usb_pid Pid, usb_device_address DeviceAddress, usb_endpoint_number EndpointNumber>
+struct usb_token_raw_data
+{
+	/// ADDR and ENDP fields of the USB token packet, in their order on the bus.
+	enum { fields = (DeviceAddress & 0x7F) | ((EndpointNumber & 0x0F) << 7) };
+
+	/// CRC5 field of the USB token packet.
+	enum { crc5 = usb_crc5_entry<fields, 11>::value };
+
+	/// Raw data of the USB token packet.
+	static const BYTE value[packetSizeToken];
+};
+
+template<usb_pid Pid, usb_device_address DeviceAddress, usb_endpoint_number EndpointNumber>
+const BYTE usb_token_raw_data<Pid, DeviceAddress, EndpointNumber>::value[packetSizeToken] =
+{
+	Pid,
+	(BYTE) fields,
+	(BYTE) ((fields >> 8) | (crc5 << 3)),
+};
+
 /// @brief
 ///		USB extended token packet.
 /// @remarks
@@ -87,6 +87,11 @@ void UsbPacket::SetTime(usb_time time)
 	m_time = time;
 }
 
+void UsbPacket::SetTicks(usb_ticks ticks)
+{
+	m_time = UsbTicksToTime(ticks);
+}
+
 void UsbPacket::SetSpeed(usb_speed speed)
 {
 	m_speed = speed;
@@ -97,6 +102,11 @@ usb_time UsbPacket::GetTime() const
 	return m_time;
 }
 
+usb_ticks UsbPacket::GetTicks() const
+{
+	return UsbTimeToTicks(m_time);
+}
+
 usb_speed UsbPacket::GetSpeed() const
 {
 	return m_speed;
@@ -181,7 +191,7 @@ usb_crc5 UsbPacketStartOfFrame::GetComputedCRC() const
 
 	if(GetRawData().size() >= 3)
 	{
-		computedCrc = UsbCRC::ComputeUsbCRC5(&GetRawData()[1], 11);;
+		computedCrc = UsbCRC::ComputeUsbCRC5Of11Bits((WORD) (GetRawData()[1] | (GetRawData()[2] << 8)));
 	}
 
 	return computedCrc;
@@ -231,7 +241,7 @@ usb_crc5 UsbPacketToken::GetComputedCRC() const
 
 	if(GetRawData().size() >= 3)
 	{
-		computedCrc = UsbCRC::ComputeUsbCRC5(&GetRawData()[1], 11);
+		computedCrc = UsbCRC::ComputeUsbCRC5Of11Bits((WORD) (GetRawData()[1] | (GetRawData()[2] << 8)));
 	}
 
 	return computedCrc;
@@ -269,7 +279,10 @@ usb_crc16 UsbPacketData::GetComputedCRC() const
 
 	if(GetRawData().size() >= 3)
 	{
-		computedCrc = UsbCRC::ComputeUsbCRC16(&GetRawData()[1], GetRawData().size() - 3);
+		const TContainer& rawData = GetRawData();
+
+		// The CRC-16 covers the payload, between the PID and the CRC-16
+		computedCrc = UsbCRC::ComputeUsbCRC16(rawData.begin() + 1, rawData.end() - 2);
 	}
 
 	return computedCrc;
@@ -357,7 +370,7 @@ usb_crc5 UsbPacketSplit::GetComputedCRC() const
 
 	if(GetRawData().size() >= 4)
 	{
-		computedCrc = UsbCRC::ComputeUsbCRC5(&GetRawData()[1], 19);
+		computedCrc = UsbCRC::ComputeUsbCRC5Of19Bits(GetRawData()[1] | (GetRawData()[2] << 8) | ((DWORD) GetRawData()[3] << 16));
 	}
 
 	return computedCrc;
@@ -0,0 +1,803 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/// @file UsbTransfers.h
+/// @brief
+///		USB Analysis SDK transfers declarations.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+namespace usbdk {
+
+/// @brief
+///		Specifies how an USB transfer ended.
+enum usb_transfer_status
+{
+	transferStatusCompleted,	///< The transfer was acknowledged by the device
+	transferStatusStalled,		///< The device stalled the transfer
+	transferStatusAborted,		///< The transfer was interrupted by a new transfer, a reset or the end of the analysis
+	transferStatusTimedOut,		///< The transfer was not completed in time
+};
+
+//---------------------------------------------------------------
+// UsbControlTransfer
+//---------------------------------------------------------------
+
+/// @brief
+/// 	Represents an USB control transfer.
+/// @remarks
+/// 	A control transfer is made of a setup stage, an optional data stage and
+/// 	a status stage. The payloads of the data stage are gathered in a single
+/// 	contiguous buffer. The NAKed transactions are only counted.
+/// @seealso
+/// 	UsbControlTransferReassembler
+class UsbControlTransfer
+{
+	friend class UsbControlTransferReassembler;
+
+private:
+	usb_device_address m_deviceAddress;
+	usb_endpoint_number m_endpointNumber;
+	usb_speed m_speed;
+	setup_request m_request;
+	std::vector<BYTE> m_data;
+	usb_ticks m_beginTicks;
+	usb_ticks m_endTicks;
+	usb_transfer_status m_status;
+	size_t m_nakCount;
+
+public:
+	/// @brief
+	/// 	Constructs an empty UsbControlTransfer object.
+	inline UsbControlTransfer();
+
+public:
+	/// @brief
+	/// 	Gets the address of the device.
+	inline usb_device_address GetDeviceAddress() const;
+
+	/// @brief
+	/// 	Gets the number of the control endpoint.
+	inline usb_endpoint_number GetEndpointNumber() const;
+
+	/// @brief
+	/// 	Gets the speed of the transfer.
+	inline usb_speed GetSpeed() const;
+
+	/// @brief
+	/// 	Gets the setup request sent in the setup stage.
+	inline const setup_request& GetRequest() const;
+
+	/// @brief
+	/// 	Determines whether the data stage is from the device to the host.
+	inline bool IsDirectionIn() const;
+
+	/// @brief
+	/// 	Gets the data of the data stage.
+	/// @remarks
+	/// 	The data is valid until the reassembler receives the next element.
+	inline vector_usbdata GetData() const;
+
+	/// @brief
+	/// 	Gets the time of the setup token packet.
+	inline usb_ticks GetBeginTicks() const;
+
+	/// @brief
+	/// 	Gets the time of the last packet of the transfer.
+	inline usb_ticks GetEndTicks() const;
+
+	/// @brief
+	/// 	Gets the time between the setup stage and the end of the transfer.
+	inline usb_ticks GetLatency() const;
+
+	/// @brief
+	/// 	Gets how the transfer ended.
+	inline usb_transfer_status GetStatus() const;
+
+	/// @brief
+	/// 	Gets the count of transactions NAKed by the device during the transfer.
+	inline size_t GetNakCount() const;
+
+private:
+	inline void Begin(const UsbTransaction* pSetupTransaction);
+};
+
+//---------------------------------------------------------------
+// UsbControlTransferReassembler
+//---------------------------------------------------------------
+
+/// @brief
+/// 	Base class of the sinks processing USB control transfers.
+/// @remarks
+/// 	The transactions are stitched into control transfers while they arrive,
+/// 	with no transaction kept. Each completed, stalled or aborted transfer is
+/// 	given to ProcessControlTransfer. All the elements are then sent to the
+/// 	next sink.
+///
+/// 	The state of an endpoint is found in constant time, and is allocated
+/// 	on its first setup transaction. The data stage retries with a repeated
+/// 	data toggle are ignored. A transfer is aborted by a new setup on its
+/// 	endpoint or by a reset, and the pending transfers are aborted by
+/// 	FinalizeElementSink.
+///
+/// 	The split transactions, used by full and low speed devices behind high
+/// 	speed hubs, are not reassembled.
+/// @seealso
+/// 	UsbControlTransfer
+/// @sample
+/// \code
+/// class RequestLogger : public usbdk::UsbControlTransferReassembler
+/// {
+/// protected:
+///     virtual void ProcessControlTransfer(const usbdk::UsbControlTransfer& transfer)
+///     {
+///         _tprintf(_T("%d: request %02X, %d bytes\n"), transfer.GetDeviceAddress(),
+///             transfer.GetRequest().bRequest, transfer.GetData().size());
+///     }
+/// };
+/// \endcode
+class UsbControlTransferReassembler : public UsbElementVisitor<UsbControlTransferReassembler>
+{
+	friend class UsbElementVisitor<UsbControlTransferReassembler>;
+
+private:
+	enum control_stage
+	{
+		stageIdle,
+		stageData,
+		stageStatus,
+	};
+
+	struct endpoint_state
+	{
+		control_stage stage;
+		usb_pid nextDataPid;
+		UsbControlTransfer transfer;
+	};
+
+	endpoint_state* m_pStates[max_device_count*max_endpoint_count];
+
+public:
+	/// @brief
+	/// 	Constructs a UsbControlTransferReassembler object.
+	/// @seealso
+	/// 	~UsbControlTransferReassembler()
+	inline UsbControlTransferReassembler();
+
+	/// @brief
+	/// 	Destroys a UsbControlTransferReassembler object.
+	/// @seealso
+	/// 	UsbControlTransferReassembler()
+	inline virtual ~UsbControlTransferReassembler();
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	The pending transfers are discarded. A derived class overriding this
+	/// 	method must call it.
+	inline virtual void InitializeElementSink();
+
+	/// @brief
+	/// 	Finalizes the sink.
+	/// @remarks
+	/// 	The pending transfers are processed as aborted. A derived class
+	/// 	overriding this method must call it.
+	inline virtual void FinalizeElementSink();
+
+protected:
+	/// @brief
+	/// 	Processes a control transfer.
+	/// @param
+	/// 	transfer - The transfer, valid only during the call.
+	virtual void ProcessControlTransfer(const UsbControlTransfer& transfer) = 0;
+
+	/// @brief
+	/// 	Processes a reset of the bus.
+	/// @remarks
+	/// 	This method is called after the pending transfers are aborted. The
+	/// 	default implementation does nothing.
+	/// @param
+	/// 	pReset - The reset element.
+	inline virtual void ProcessBusReset(UsbReset* pReset);
+
+	inline void ProcessTransaction(UsbTransaction* pTransaction);
+	inline void ProcessReset(UsbReset* pReset);
+
+private:
+	inline void EndTransfer(endpoint_state& state, usb_transfer_status status);
+	inline void AbortTransfers();
+	inline void DeleteStates();
+
+private:
+	UsbControlTransferReassembler(const UsbControlTransferReassembler&);
+	UsbControlTransferReassembler& operator=(const UsbControlTransferReassembler&);
+};
+
+//---------------------------------------------------------------
+// UsbDataTransfer
+//---------------------------------------------------------------
+
+/// @brief
+/// 	Represents an USB bulk or interrupt transfer.
+/// @remarks
+/// 	A data transfer is made of the consecutive transactions of an endpoint,
+/// 	up to a short packet or a zero-length packet. The payload is not copied:
+/// 	it is a scatter list of the data of the transactions, which are
+/// 	referenced by the transfer. A copy of the transfer references the same
+/// 	transactions.
+/// @seealso
+/// 	UsbDataTransferReassembler
+class UsbDataTransfer
+{
+	friend class UsbDataTransferReassembler;
+
+private:
+	typedef std::vector<UsbTransaction*> vector_transaction;
+
+	usb_device_address m_deviceAddress;
+	usb_endpoint_number m_endpointNumber;
+	bool m_isDirectionIn;
+	usb_speed m_speed;
+	vector_transaction m_transactions;
+	size_t m_size;
+	usb_ticks m_beginTicks;
+	usb_ticks m_endTicks;
+	usb_transfer_status m_status;
+	size_t m_nakCount;
+	size_t m_retryCount;
+	bool m_isZeroLengthTerminated;
+
+public:
+	/// @brief
+	/// 	Constructs an empty UsbDataTransfer object.
+	/// @seealso
+	/// 	~UsbDataTransfer()
+	inline UsbDataTransfer();
+
+	/// @brief
+	/// 	Constructs a UsbDataTransfer object referencing the transactions of another one.
+	inline UsbDataTransfer(const UsbDataTransfer& right);
+
+	/// @brief
+	/// 	Destroys a UsbDataTransfer object.
+	/// @remarks
+	/// 	The transactions are released.
+	/// @seealso
+	/// 	UsbDataTransfer()
+	inline ~UsbDataTransfer();
+
+	/// @brief
+	/// 	References the transactions of another transfer.
+	inline UsbDataTransfer& operator=(const UsbDataTransfer& right);
+
+public:
+	/// @brief
+	/// 	Gets the address of the device.
+	inline usb_device_address GetDeviceAddress() const;
+
+	/// @brief
+	/// 	Gets the number of the endpoint.
+	inline usb_endpoint_number GetEndpointNumber() const;
+
+	/// @brief
+	/// 	Determines whether the transfer is from the device to the host.
+	inline bool IsDirectionIn() const;
+
+	/// @brief
+	/// 	Gets the speed of the transfer.
+	inline usb_speed GetSpeed() const;
+
+	/// @brief
+	/// 	Gets the count of bytes of the transfer.
+	inline size_t GetSize() const;
+
+	/// @brief
+	/// 	Gets the count of data segments of the transfer.
+	/// @remarks
+	/// 	Each segment is the data of a transaction.
+	/// @seealso
+	/// 	GetSegment
+	inline size_t GetSegmentCount() const;
+
+	/// @brief
+	/// 	Gets a data segment of the transfer.
+	/// @remarks
+	/// 	The data is in the raw data of the packet, valid while the transfer exists.
+	/// @param
+	/// 	index - The index of the segment, lower than GetSegmentCount.
+	inline vector_usbdata GetSegment(size_t index) const;
+
+	/// @brief
+	/// 	Gets the transaction of a data segment.
+	/// @param
+	/// 	index - The index of the segment, lower than GetSegmentCount.
+	inline const UsbTransaction* GetSegmentTransaction(size_t index) const;
+
+	/// @brief
+	/// 	Gets the time of the token packet of the first data transaction.
+	inline usb_ticks GetBeginTicks() const;
+
+	/// @brief
+	/// 	Gets the time of the last packet of the transfer.
+	inline usb_ticks GetEndTicks() const;
+
+	/// @brief
+	/// 	Gets the time between the beginning and the end of the transfer.
+	inline usb_ticks GetDuration() const;
+
+	/// @brief
+	/// 	Gets how the transfer ended.
+	inline usb_transfer_status GetStatus() const;
+
+	/// @brief
+	/// 	Gets the count of transactions NAKed since the previous transfer of the endpoint.
+	inline size_t GetNakCount() const;
+
+	/// @brief
+	/// 	Gets the count of retransmitted transactions ignored during the transfer.
+	inline size_t GetRetryCount() const;
+
+	/// @brief
+	/// 	Determines whether the transfer was ended by a zero-length packet.
+	inline bool IsZeroLengthTerminated() const;
+
+private:
+	inline void Begin(const UsbTransaction* pTransaction);
+	inline void Clear();
+	inline void AddTransaction(UsbTransaction* pTransaction, size_t size);
+};
+
+//---------------------------------------------------------------
+// UsbDataTransferReassembler
+//---------------------------------------------------------------
+
+/// @brief
+/// 	Base class of the sinks processing USB bulk and interrupt transfers.
+/// @remarks
+/// 	The acknowledged data transactions of each endpoint are gathered into a
+/// 	transfer, ended by a packet shorter than the maximum packet size of the
+/// 	endpoint, which includes the zero-length packets. Each transfer is given
+/// 	to ProcessDataTransfer. All the elements are then sent to the next sink.
+///
+/// 	A transaction with the data toggle and the payload of the previous one
+/// 	is a retransmission, after a lost handshake, and is ignored. The NAKed
+/// 	transactions are only counted. A stall ends the transfer, and a reset
+/// 	or FinalizeElementSink aborts the pending transfers.
+///
+/// 	The endpoints 0 are not reassembled, as the transactions without a
+/// 	handshake like the isochronous ones. The maximum packet size of an
+/// 	endpoint is given by GetMaxPacketSize. Otherwise, it is the largest
+/// 	packet seen on the endpoint, and at least the maximum bulk packet size
+/// 	for its speed. The split transactions are not reassembled.
+///
+/// 	The state of an endpoint is found in constant time. Only the
+/// 	transactions of the pending transfers, and the last transaction of
+/// 	each endpoint, are referenced.
+/// @seealso
+/// 	UsbDataTransfer
+/// @sample
+/// \code
+/// class ThroughputMeter : public usbdk::UsbDataTransferReassembler
+/// {
+/// public:
+///     DWORDLONG m_byteCount;
+/// 
+/// protected:
+///     virtual void ProcessDataTransfer(const usbdk::UsbDataTransfer& transfer)
+///     {
+///         if(transfer.GetStatus() == usbdk::transferStatusCompleted)
+///         {
+///             m_byteCount += transfer.GetSize();
+///         }
+///     }
+/// };
+/// \endcode
+class UsbDataTransferReassembler : public UsbElementVisitor<UsbDataTransferReassembler>
+{
+	friend class UsbElementVisitor<UsbDataTransferReassembler>;
+
+private:
+	struct endpoint_state
+	{
+		size_t maxPacketSize;
+		UsbTransaction* pLastTransaction;
+		UsbDataTransfer transfer;
+		size_t nakCount;
+	};
+
+	enum { stateCount = max_device_count*max_endpoint_count*2 };
+	endpoint_state* m_pStates[stateCount];
+
+public:
+	/// @brief
+	/// 	Constructs a UsbDataTransferReassembler object.
+	/// @seealso
+	/// 	~UsbDataTransferReassembler()
+	inline UsbDataTransferReassembler();
+
+	/// @brief
+	/// 	Destroys a UsbDataTransferReassembler object.
+	/// @seealso
+	/// 	UsbDataTransferReassembler()
+	inline virtual ~UsbDataTransferReassembler();
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	The pending transfers are discarded. A derived class overriding this
+	/// 	method must call it.
+	inline virtual void InitializeElementSink();
+
+	/// @brief
+	/// 	Finalizes the sink.
+	/// @remarks
+	/// 	The pending transfers are processed as aborted. A derived class
+	/// 	overriding this method must call it.
+	inline virtual void FinalizeElementSink();
+
+protected:
+	/// @brief
+	/// 	Processes a data transfer.
+	/// @param
+	/// 	transfer - The transfer, valid only during the call. It can be
+	/// 	copied to keep its transactions.
+	virtual void ProcessDataTransfer(const UsbDataTransfer& transfer) = 0;
+
+	/// @brief
+	/// 	Gets the maximum packet size of an endpoint.
+	/// @param
+	/// 	deviceAddress - The address of the device.
+	/// @param
+	/// 	endpointNumber - The number of the endpoint.
+	/// @param
+	/// 	isDirectionIn - The direction of the endpoint.
+	/// @return
+	/// 	The maximum packet size, or 0 if it is unknown.
+	inline virtual size_t GetMaxPacketSize(usb_device_address deviceAddress, usb_endpoint_number endpointNumber, bool isDirectionIn) const;
+
+	inline void ProcessTransaction(UsbTransaction* pTransaction);
+	inline void ProcessReset(UsbReset* pReset);
+
+private:
+	inline void EndTransfer(endpoint_state& state, usb_transfer_status status);
+	inline void AbortTransfers();
+	inline void DeleteStates();
+	inline static bool IsRetransmission(const UsbTransaction* pTransaction, const UsbTransaction* pLastTransaction);
+	inline static size_t GetDefaultMaxPacketSize(usb_speed speed);
+
+private:
+	UsbDataTransferReassembler(const UsbDataTransferReassembler&);
+	UsbDataTransferReassembler& operator=(const UsbDataTransferReassembler&);
+};
+
+//---------------------------------------------------------------
+// UsbSplitTransfer
+//---------------------------------------------------------------
+
+/// @brief
+/// 	Represents an USB transaction of a full or low speed device behind a
+/// 	high speed hub, carried by split transactions.
+/// @remarks
+/// 	A split transfer is made of the start split accepted by the transaction
+/// 	translator of the hub, and of the complete splits returning the result
+/// 	of the transaction. The complete splits answered by NYET are only
+/// 	counted. The isochronous OUT transfers have no complete split, and their
+/// 	payload can be split over several start splits. The interrupt and
+/// 	isochronous IN transfers can return their payload over several complete
+/// 	splits. The split transactions are referenced by the transfer.
+///
+/// 	The status is transferStatusCompleted whatever the result given by the
+/// 	device, including a NAK, see GetResultPid.
+/// @seealso
+/// 	UsbSplitTransferMatcher
+class UsbSplitTransfer
+{
+	friend class UsbSplitTransferMatcher;
+
+private:
+	typedef std::vector<UsbSplitTransaction*> vector_split_transaction;
+
+	vector_split_transaction m_startSplits;
+	vector_split_transaction m_completeSplits;
+	usb_ticks m_resultTicks;
+	usb_ticks m_endTicks;
+	usb_transfer_status m_status;
+	size_t m_nyetCount;
+	size_t m_startRetryCount;
+
+public:
+	/// @brief
+	/// 	Constructs an empty UsbSplitTransfer object.
+	/// @seealso
+	/// 	~UsbSplitTransfer()
+	inline UsbSplitTransfer();
+
+	/// @brief
+	/// 	Constructs a UsbSplitTransfer object referencing the split transactions of another one.
+	inline UsbSplitTransfer(const UsbSplitTransfer& right);
+
+	/// @brief
+	/// 	Destroys a UsbSplitTransfer object.
+	/// @remarks
+	/// 	The split transactions are released.
+	/// @seealso
+	/// 	UsbSplitTransfer()
+	inline ~UsbSplitTransfer();
+
+	/// @brief
+	/// 	References the split transactions of another transfer.
+	inline UsbSplitTransfer& operator=(const UsbSplitTransfer& right);
+
+public:
+	/// @brief
+	/// 	Gets the address of the high speed hub.
+	inline usb_device_address GetHubAddress() const;
+
+	/// @brief
+	/// 	Gets the port of the hub where the device is connected.
+	inline usb_hubport_number GetHubPort() const;
+
+	/// @brief
+	/// 	Gets the address of the device.
+	inline usb_device_address GetDeviceAddress() const;
+
+	/// @brief
+	/// 	Gets the number of the endpoint.
+	inline usb_endpoint_number GetEndpointNumber() const;
+
+	/// @brief
+	/// 	Gets the type of the endpoint.
+	inline usb_split_endpoint_type GetEndpointType() const;
+
+	/// @brief
+	/// 	Gets the speed of the device.
+	inline usb_split_speed GetSplitSpeed() const;
+
+	/// @brief
+	/// 	Gets the PID of the token of the transaction.
+	inline usb_pid GetTokenPid() const;
+
+	/// @brief
+	/// 	Determines whether the transfer is from the device to the host.
+	inline bool IsDirectionIn() const;
+
+	/// @brief
+	/// 	Gets the count of start splits of the transfer.
+	inline size_t GetStartSplitCount() const;
+
+	/// @brief
+	/// 	Gets a start split of the transfer.
+	/// @param
+	/// 	index - The index of the start split, lower than GetStartSplitCount.
+	inline const UsbSplitTransaction* GetStartSplit(size_t index) const;
+
+	/// @brief
+	/// 	Gets the count of complete splits of the transfer, not answered by NYET.
+	inline size_t GetCompleteSplitCount() const;
+
+	/// @brief
+	/// 	Gets a complete split of the transfer.
+	/// @param
+	/// 	index - The index of the complete split, lower than GetCompleteSplitCount.
+	inline const UsbSplitTransaction* GetCompleteSplit(size_t index) const;
+
+	/// @brief
+	/// 	Gets the result of the transaction.
+	/// @return
+	/// 	The PID of the handshake or of the data packet of the last complete
+	/// 	split, or pidUnknown if there is no complete split.
+	inline usb_pid GetResultPid() const;
+
+	/// @brief
+	/// 	Gets the time of the split packet of the first start split.
+	inline usb_ticks GetBeginTicks() const;
+
+	/// @brief
+	/// 	Gets the time of the last packet of the transfer.
+	inline usb_ticks GetEndTicks() const;
+
+	/// @brief
+	/// 	Gets the latency of the transaction translator.
+	/// @return
+	/// 	The time between the end of the last start split and the first
+	/// 	complete split not answered by NYET, or 0 if there is none.
+	inline usb_ticks GetTtLatency() const;
+
+	/// @brief
+	/// 	Gets how the transfer ended.
+	inline usb_transfer_status GetStatus() const;
+
+	/// @brief
+	/// 	Gets the count of complete splits answered by NYET.
+	inline size_t GetNyetCount() const;
+
+	/// @brief
+	/// 	Gets the count of start splits NAKed by the hub before the transfer.
+	/// @remarks
+	/// 	The hub NAKs the bulk and control start splits when its buffers are full.
+	inline size_t GetStartRetryCount() const;
+
+private:
+	inline void Clear();
+	inline void AddStartSplit(UsbSplitTransaction* pSplitTransaction);
+	inline void AddCompleteSplit(UsbSplitTransaction* pSplitTransaction);
+};
+
+//---------------------------------------------------------------
+// UsbSplitTransferMatcher
+//---------------------------------------------------------------
+
+/// @brief
+/// 	Base class of the sinks processing the USB split transfers.
+/// @remarks
+/// 	The start and complete split transactions are paired while they arrive.
+/// 	Each completed, aborted or timed out split transfer is given to
+/// 	ProcessSplitTransfer. All the elements are then sent to the next sink.
+///
+/// 	The pending transfers are kept in a hash table keyed on the hub address,
+/// 	the hub port, the device address, the endpoint number and, except for
+/// 	the control endpoints, the direction. A transfer is found in constant
+/// 	time, and at most GetCapacity endpoints are tracked. When the table is
+/// 	full, the least recently used endpoint is evicted. A transfer keeps at
+/// 	most maxSplitCount start splits and complete splits, and is aborted
+/// 	beyond.
+///
+/// 	A pending transfer is timed out when no split transaction of its
+/// 	endpoint is seen during the timeout. A new start split on an endpoint
+/// 	with a pending transfer aborts it. A complete split without pending
+/// 	transfer is only counted, see GetUnmatchedCount. A reset or
+/// 	FinalizeElementSink aborts the pending transfers.
+/// @seealso
+/// 	UsbSplitTransfer
+/// @sample
+/// \code
+/// class TtLatencyMeter : public usbdk::UsbSplitTransferMatcher
+/// {
+/// public:
+///     usbdk::usb_ticks m_maxLatency;
+/// 
+/// protected:
+///     virtual void ProcessSplitTransfer(const usbdk::UsbSplitTransfer& transfer)
+///     {
+///         if(transfer.GetTtLatency() > m_maxLatency)
+///         {
+///             m_maxLatency = transfer.GetTtLatency();
+///         }
+///     }
+/// };
+/// \endcode
+class UsbSplitTransferMatcher : public UsbElementVisitor<UsbSplitTransferMatcher>
+{
+	friend class UsbElementVisitor<UsbSplitTransferMatcher>;
+
+public:
+	enum
+	{
+		defaultCapacity = 256,		///< Default count of endpoints tracked
+		maxSplitCount = 8,			///< Maximum count of start splits and of complete splits of a transfer
+	};
+
+	/// Default timeout, two frames.
+	static const usb_ticks defaultTimeout = usb_ticks_per_second / 500;
+
+private:
+	struct split_state
+	{
+		bool isUsed;
+		bool isPending;
+		DWORD key;
+		usb_ticks lastTicks;
+		size_t startRetryCount;
+		UsbSplitTransfer transfer;
+	};
+
+	split_state* m_pStates;
+	size_t m_capacity;
+	size_t m_requestedCapacity;
+	size_t m_count;
+	usb_ticks m_timeout;
+	usb_ticks m_lastSweepTicks;
+	size_t m_unmatchedCount;
+	size_t m_evictedCount;
+
+public:
+	/// @brief
+	/// 	Constructs a UsbSplitTransferMatcher object.
+	/// @seealso
+	/// 	~UsbSplitTransferMatcher()
+	inline UsbSplitTransferMatcher();
+
+	/// @brief
+	/// 	Destroys a UsbSplitTransferMatcher object.
+	/// @seealso
+	/// 	UsbSplitTransferMatcher()
+	inline virtual ~UsbSplitTransferMatcher();
+
+public:
+	/// @brief
+	/// 	Sets the maximum count of endpoints tracked.
+	/// @remarks
+	/// 	The capacity is rounded up to a power of two, and is used by the next
+	/// 	call to InitializeElementSink. The default capacity is defaultCapacity.
+	inline void SetCapacity(size_t capacity);
+
+	/// @brief
+	/// 	Gets the maximum count of endpoints tracked.
+	/// @remarks
+	/// 	This is the capacity of the current table, a capacity set by
+	/// 	SetCapacity is only returned after the next InitializeElementSink.
+	inline size_t GetCapacity() const;
+
+	/// @brief
+	/// 	Sets the time after which a pending transfer is timed out.
+	/// @remarks
+	/// 	The default timeout is defaultTimeout.
+	inline void SetTimeout(usb_ticks timeout);
+
+	/// @brief
+	/// 	Gets the time after which a pending transfer is timed out.
+	inline usb_ticks GetTimeout() const;
+
+	/// @brief
+	/// 	Gets the count of complete splits without pending transfer.
+	inline size_t GetUnmatchedCount() const;
+
+	/// @brief
+	/// 	Gets the count of endpoints evicted from the full table.
+	inline size_t GetEvictedCount() const;
+
+public:
+	/// @brief
+	/// 	Initializes the sink.
+	/// @remarks
+	/// 	The pending transfers are discarded. A derived class overriding this
+	/// 	method must call it.
+	inline virtual void InitializeElementSink();
+
+	/// @brief
+	/// 	Finalizes the sink.
+	/// @remarks
+	/// 	The pending transfers are processed as aborted. A derived class
+	/// 	overriding this method must call it.
+	inline virtual void FinalizeElementSink();
+
+protected:
+	/// @brief
+	/// 	Processes a split transfer.
+	/// @param
+	/// 	transfer - The transfer, valid only during the call. It can be
+	/// 	copied to keep its split transactions.
+	virtual void ProcessSplitTransfer(const UsbSplitTransfer& transfer) = 0;
+
+	inline void ProcessSplitTransaction(UsbSplitTransaction* pSplitTransaction);
+	inline void ProcessReset(UsbReset* pReset);
+
+private:
+	inline void ProcessStartSplit(split_state& state, UsbSplitTransaction* pSplitTransaction);
+	inline void ProcessCompleteSplit(split_state& state, UsbSplitTransaction* pSplitTransaction);
+	inline split_state* FindState(DWORD key, usb_ticks ticks, bool isCreated);
+	inline void RemoveState(size_t index);
+	inline void RemoveExpiredStates(usb_ticks ticks);
+	inline void RemoveOldestState();
+	inline void EndTransfer(split_state& state, usb_transfer_status status);
+	inline void AbortTransfers();
+	inline void ClearStates();
+	inline size_t GetHomeIndex(DWORD key) const;
+	inline static DWORD GetKey(const UsbSplitTransaction* pSplitTransaction);
+
+private:
+	UsbSplitTransferMatcher(const UsbSplitTransferMatcher&);
+	UsbSplitTransferMatcher& operator=(const UsbSplitTransferMatcher&);
+};
+
+} // End of the usbdk namespace
+
+#include "UsbTransfers.inl"
@@ -0,0 +1,1328 @@
+// Copyright (C) Ellisys. All rights reserved.
+//
+// This code is provided "as is" without warranty of any kind,
+// either expressed or implied.
+//
+// Please read the license agreement for more information.
+//
+
+/////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "UsbTransfers.h"
+
+//////////////////////////////////////////////////////////////////////
+
+namespace usbdk
+{
+//---------------------------------------------------------------
+// UsbControlTransfer
+//---------------------------------------------------------------
+
+UsbControlTransfer::UsbControlTransfer() :
+	m_deviceAddress(unknown_device_address),
+	m_endpointNumber(unknown_endpoint_number),
+	m_speed(speedUnknown),
+	m_beginTicks(0),
+	m_endTicks(0),
+	m_status(transferStatusAborted),
+	m_nakCount(0)
+{
+	memset(&m_request, 0, sizeof(m_request));
+}
+
+usb_device_address UsbControlTransfer::GetDeviceAddress() const
+{
+	return m_deviceAddress;
+}
+
+usb_endpoint_number UsbControlTransfer::GetEndpointNumber() const
+{
+	return m_endpointNumber;
+}
+
+usb_speed UsbControlTransfer::GetSpeed() const
+{
+	return m_speed;
+}
+
+const setup_request& UsbControlTransfer::GetRequest() const
+{
+	return m_request;
+}
+
+bool UsbControlTransfer::IsDirectionIn() const
+{
+	return (m_request.bmRequestType & directionMask) == directionDeviceToHost;
+}
+
+vector_usbdata UsbControlTransfer::GetData() const
+{
+	if(m_data.empty())
+	{
+		return vector_usbdata();
+	}
+
+	return vector_usbdata(m_data.size(), &m_data[0]);
+}
+
+usb_ticks UsbControlTransfer::GetBeginTicks() const
+{
+	return m_beginTicks;
+}
+
+usb_ticks UsbControlTransfer::GetEndTicks() const
+{
+	return m_endTicks;
+}
+
+usb_ticks UsbControlTransfer::GetLatency() const
+{
+	return m_endTicks - m_beginTicks;
+}
+
+usb_transfer_status UsbControlTransfer::GetStatus() const
+{
+	return m_status;
+}
+
+size_t UsbControlTransfer::GetNakCount() const
+{
+	return m_nakCount;
+}
+
+void UsbControlTransfer::Begin(const UsbTransaction* pSetupTransaction)
+{
+	const vector_usbdata setupData = pSetupTransaction->GetData();
+	ASSERT(setupData.size() == sizeof(setup_request));
+
+	m_deviceAddress = pSetupTransaction->GetDeviceAddress();
+	m_endpointNumber = pSetupTransaction->GetEndpointNumber();
+	m_speed = pSetupTransaction->GetSpeed();
+	memcpy(&m_request, setupData.begin(), sizeof(m_request));
+	m_beginTicks = pSetupTransaction->GetTokenPacket().GetTicks();
+	m_status = transferStatusAborted;
+	m_nakCount = 0;
+
+	// The capacity is kept from a transfer to the next one
+	m_data.clear();
+}
+
+//---------------------------------------------------------------
+// UsbControlTransferReassembler
+//---------------------------------------------------------------
+
+UsbControlTransferReassembler::UsbControlTransferReassembler()
+{
+	memset(m_pStates, 0, sizeof(m_pStates));
+}
+
+UsbControlTransferReassembler::~UsbControlTransferReassembler()
+{
+	DeleteStates();
+}
+
+void UsbControlTransferReassembler::InitializeElementSink()
+{
+	for(size_t i=0; i<max_device_count*max_endpoint_count; ++i)
+	{
+		if(m_pStates[i] != NULL)
+		{
+			m_pStates[i]->stage = stageIdle;
+		}
+	}
+}
+
+void UsbControlTransferReassembler::FinalizeElementSink()
+{
+	AbortTransfers();
+}
+
+void UsbControlTransferReassembler::ProcessTransaction(UsbTransaction* pTransaction)
+{
+	const usb_device_address deviceAddress = pTransaction->GetDeviceAddress();
+	const usb_endpoint_number endpointNumber = pTransaction->GetEndpointNumber();
+
+	if((deviceAddress > max_device_address) || (endpointNumber > max_endpoint_number))
+	{
+		return;
+	}
+
+	endpoint_state*& pState = m_pStates[deviceAddress*max_endpoint_count + endpointNumber];
+	const usb_pid tokenPid = pTransaction->GetTokenPacket().GetPID();
+	const usb_pid handshakePid = pTransaction->GetHandshakePacket().GetPID();
+
+	if(tokenPid == pidSETUP)
+	{
+		// A setup not acknowledged is sent again by the host
+		if((handshakePid != pidACK) || (pTransaction->GetData().size() != sizeof(setup_request)))
+		{
+			return;
+		}
+
+		if(pState == NULL)
+		{
+			pState = new endpoint_state;
+			pState->stage = stageIdle;
+		}
+
+		if(pState->stage != stageIdle)
+		{
+			EndTransfer(*pState, transferStatusAborted);
+		}
+
+		UsbControlTransfer& transfer = pState->transfer;
+		transfer.Begin(pTransaction);
+		transfer.m_endTicks = pTransaction->GetEndTicks();
+
+		pState->stage = (transfer.m_request.wLength != 0) ? stageData : stageStatus;
+		pState->nextDataPid = pidDATA1;
+		return;
+	}
+
+	if((pState == NULL) || (pState->stage == stageIdle))
+	{
+		return;
+	}
+
+	UsbControlTransfer& transfer = pState->transfer;
+
+	if((tokenPid != pidIN) && (tokenPid != pidOUT))
+	{
+		// The PING transactions only poll the device for the next OUT
+		if((tokenPid == pidPING) && (handshakePid == pidNAK))
+		{
+			++transfer.m_nakCount;
+		}
+
+		return;
+	}
+
+	const bool isDirectionIn = (tokenPid == pidIN);
+
+	if((pState->stage == stageData) && (isDirectionIn != transfer.IsDirectionIn()))
+	{
+		// The host switched the direction, the data stage is over
+		pState->stage = stageStatus;
+	}
+
+	switch(handshakePid)
+	{
+	case pidNAK:
+		++transfer.m_nakCount;
+		return;
+
+	case pidSTALL:
+		transfer.m_endTicks = pTransaction->GetEndTicks();
+		EndTransfer(*pState, transferStatusStalled);
+		return;
+
+	case pidACK:
+	case pidNYET:
+		break;
+
+	default:
+		// Not acknowledged, the transaction is sent again
+		return;
+	}
+
+	transfer.m_endTicks = pTransaction->GetEndTicks();
+
+	if(pState->stage == stageData)
+	{
+		// A repeated data toggle is a retry of a transaction whose handshake was lost
+		if(pTransaction->GetDataPacket().GetPID() == pState->nextDataPid)
+		{
+			const vector_usbdata data = pTransaction->GetData();
+			transfer.m_data.insert(transfer.m_data.end(), data.begin(), data.end());
+
+			pState->nextDataPid = (pState->nextDataPid == pidDATA1) ? pidDATA0 : pidDATA1;
+
+			if(transfer.m_data.size() >= transfer.m_request.wLength)
+			{
+				pState->stage = stageStatus;
+			}
+		}
+
+		return;
+	}
+
+	// The status stage is in the opposite direction of the data stage
+	const bool isStatusIn = (transfer.m_request.wLength == 0) || !transfer.IsDirectionIn();
+
+	if(isDirectionIn == isStatusIn)
+	{
+		EndTransfer(*pState, transferStatusCompleted);
+	}
+}
+
+void UsbControlTransferReassembler::ProcessBusReset(UsbReset*)
+{
+}
+
+void UsbControlTransferReassembler::ProcessReset(UsbReset* pReset)
+{
+	AbortTransfers();
+	ProcessBusReset(pReset);
+}
+
+void UsbControlTransferReassembler::EndTransfer(endpoint_state& state, usb_transfer_status status)
+{
+	state.stage = stageIdle;
+	state.transfer.m_status = status;
+
+	ProcessControlTransfer(state.transfer);
+}
+
+void UsbControlTransferReassembler::AbortTransfers()
+{
+	for(size_t i=0; i<max_device_count*max_endpoint_count; ++i)
+	{
+		if((m_pStates[i] != NULL) && (m_pStates[i]->stage != stageIdle))
+		{
+			EndTransfer(*m_pStates[i], transferStatusAborted);
+		}
+	}
+}
+
+void UsbControlTransferReassembler::DeleteStates()
+{
+	for(size_t i=0; i<max_device_count*max_endpoint_count; ++i)
+	{
+		delete m_pStates[i];
+		m_pStates[i] = NULL;
+	}
+}
+
+//---------------------------------------------------------------
+// UsbDataTransfer
+//---------------------------------------------------------------
+
+UsbDataTransfer::UsbDataTransfer() :
+	m_deviceAddress(unknown_device_address),
+	m_endpointNumber(unknown_endpoint_number),
+	m_isDirectionIn(false),
+	m_speed(speedUnknown),
+	m_size(0),
+	m_beginTicks(0),
+	m_endTicks(0),
+	m_status(transferStatusAborted),
+	m_nakCount(0),
+	m_retryCount(0),
+	m_isZeroLengthTerminated(false)
+{
+}
+
+UsbDataTransfer::UsbDataTransfer(const UsbDataTransfer& right) :
+	m_deviceAddress(right.m_deviceAddress),
+	m_endpointNumber(right.m_endpointNumber),
+	m_isDirectionIn(right.m_isDirectionIn),
+	m_speed(right.m_speed),
+	m_transactions(right.m_transactions),
+	m_size(right.m_size),
+	m_beginTicks(right.m_beginTicks),
+	m_endTicks(right.m_endTicks),
+	m_status(right.m_status),
+	m_nakCount(right.m_nakCount),
+	m_retryCount(right.m_retryCount),
+	m_isZeroLengthTerminated(right.m_isZeroLengthTerminated)
+{
+	for(vector_transaction::iterator it = m_transactions.begin(); it != m_transactions.end(); ++it)
+	{
+		(*it)->AddRef();
+	}
+}
+
+UsbDataTransfer::~UsbDataTransfer()
+{
+	Clear();
+}
+
+UsbDataTransfer& UsbDataTransfer::operator=(const UsbDataTransfer& right)
+{
+	if(this != &right)
+	{
+		for(vector_transaction::const_iterator it = right.m_transactions.begin(); it != right.m_transactions.end(); ++it)
+		{
+			(*it)->AddRef();
+		}
+
+		Clear();
+
+		m_deviceAddress = right.m_deviceAddress;
+		m_endpointNumber = right.m_endpointNumber;
+		m_isDirectionIn = right.m_isDirectionIn;
+		m_speed = right.m_speed;
+		m_transactions = right.m_transactions;
+		m_size = right.m_size;
+		m_beginTicks = right.m_beginTicks;
+		m_endTicks = right.m_endTicks;
+		m_status = right.m_status;
+		m_nakCount = right.m_nakCount;
+		m_retryCount = right.m_retryCount;
+		m_isZeroLengthTerminated = right.m_isZeroLengthTerminated;
+	}
+
+	return *this;
+}
+
+usb_device_address UsbDataTransfer::GetDeviceAddress() const
+{
+	return m_deviceAddress;
+}
+
+usb_endpoint_number UsbDataTransfer::GetEndpointNumber() const
+{
+	return m_endpointNumber;
+}
+
+bool UsbDataTransfer::IsDirectionIn() const
+{
+	return m_isDirectionIn;
+}
+
+usb_speed UsbDataTransfer::GetSpeed() const
+{
+	return m_speed;
+}
+
+size_t UsbDataTransfer::GetSize() const
+{
+	return m_size;
+}
+
+size_t UsbDataTransfer::GetSegmentCount() const
+{
+	return m_transactions.size();
+}
+
+vector_usbdata UsbDataTransfer::GetSegment(size_t index) const
+{
+	return m_transactions[index]->GetData();
+}
+
+const UsbTransaction* UsbDataTransfer::GetSegmentTransaction(size_t index) const
+{
+	return m_transactions[index];
+}
+
+usb_ticks UsbDataTransfer::GetBeginTicks() const
+{
+	return m_beginTicks;
+}
+
+usb_ticks UsbDataTransfer::GetEndTicks() const
+{
+	return m_endTicks;
+}
+
+usb_ticks UsbDataTransfer::GetDuration() const
+{
+	return m_endTicks - m_beginTicks;
+}
+
+usb_transfer_status UsbDataTransfer::GetStatus() const
+{
+	return m_status;
+}
+
+size_t UsbDataTransfer::GetNakCount() const
+{
+	return m_nakCount;
+}
+
+size_t UsbDataTransfer::GetRetryCount() const
+{
+	return m_retryCount;
+}
+
+bool UsbDataTransfer::IsZeroLengthTerminated() const
+{
+	return m_isZeroLengthTerminated;
+}
+
+void UsbDataTransfer::Begin(const UsbTransaction* pTransaction)
+{
+	m_deviceAddress = pTransaction->GetDeviceAddress();
+	m_endpointNumber = pTransaction->GetEndpointNumber();
+	m_isDirectionIn = (pTransaction->GetTokenPacket().GetPID() == pidIN);
+	m_speed = pTransaction->GetSpeed();
+	m_beginTicks = pTransaction->GetTokenPacket().GetTicks();
+}
+
+void UsbDataTransfer::Clear()
+{
+	for(vector_transaction::iterator it = m_transactions.begin(); it != m_transactions.end(); ++it)
+	{
+		(*it)->Release();
+	}
+
+	// The capacity is kept from a transfer to the next one
+	m_transactions.clear();
+	m_size = 0;
+	m_status = transferStatusAborted;
+	m_nakCount = 0;
+	m_retryCount = 0;
+	m_isZeroLengthTerminated = false;
+}
+
+void UsbDataTransfer::AddTransaction(UsbTransaction* pTransaction, size_t size)
+{
+	pTransaction->AddRef();
+	m_transactions.push_back(pTransaction);
+	m_size += size;
+}
+
+//---------------------------------------------------------------
+// UsbDataTransferReassembler
+//---------------------------------------------------------------
+
+UsbDataTransferReassembler::UsbDataTransferReassembler()
+{
+	memset(m_pStates, 0, sizeof(m_pStates));
+}
+
+UsbDataTransferReassembler::~UsbDataTransferReassembler()
+{
+	DeleteStates();
+}
+
+void UsbDataTransferReassembler::InitializeElementSink()
+{
+	DeleteStates();
+}
+
+void UsbDataTransferReassembler::FinalizeElementSink()
+{
+	AbortTransfers();
+}
+
+size_t UsbDataTransferReassembler::GetMaxPacketSize(usb_device_address, usb_endpoint_number, bool) const
+{
+	return 0;
+}
+
+void UsbDataTransferReassembler::ProcessTransaction(UsbTransaction* pTransaction)
+{
+	const usb_device_address deviceAddress = pTransaction->GetDeviceAddress();
+	const usb_endpoint_number endpointNumber = pTransaction->GetEndpointNumber();
+
+	if((deviceAddress > max_device_address) || (endpointNumber == 0) || (endpointNumber > max_endpoint_number))
+	{
+		return;
+	}
+
+	const usb_pid tokenPid = pTransaction->GetTokenPacket().GetPID();
+	const bool isDirectionIn = (tokenPid == pidIN);
+
+	if(!isDirectionIn && (tokenPid != pidOUT) && (tokenPid != pidPING))
+	{
+		return;
+	}
+
+	const usb_pid handshakePid = pTransaction->GetHandshakePacket().GetPID();
+
+	if((handshakePid != pidACK) && (handshakePid != pidNYET) && (handshakePid != pidNAK) && (handshakePid != pidSTALL))
+	{
+		// Not acknowledged, or isochronous
+		return;
+	}
+
+	endpoint_state*& pState = m_pStates[(deviceAddress*max_endpoint_count + endpointNumber)*2 + (isDirectionIn ? 1 : 0)];
+
+	if(pState == NULL)
+	{
+		pState = new endpoint_state;
+		pState->maxPacketSize = 0;
+		pState->pLastTransaction = NULL;
+	}
+
+	UsbDataTransfer& transfer = pState->transfer;
+
+	if(handshakePid == pidNAK)
+	{
+		++transfer.m_nakCount;
+		return;
+	}
+
+	if(handshakePid == pidSTALL)
+	{
+		if(transfer.m_transactions.empty())
+		{
+			transfer.Begin(pTransaction);
+		}
+
+		transfer.m_endTicks = pTransaction->GetEndTicks();
+		EndTransfer(*pState, transferStatusStalled);
+
+		// The data toggle is reset when the halt is cleared
+		if(pState->pLastTransaction != NULL)
+		{
+			pState->pLastTransaction->Release();
+			pState->pLastTransaction = NULL;
+		}
+
+		return;
+	}
+
+	const usb_pid dataPid = pTransaction->GetDataPacket().GetPID();
+
+	if((tokenPid == pidPING) || ((dataPid != pidDATA0) && (dataPid != pidDATA1)))
+	{
+		return;
+	}
+
+	if(IsRetransmission(pTransaction, pState->pLastTransaction))
+	{
+		++transfer.m_retryCount;
+		return;
+	}
+
+	pTransaction->AddRef();
+
+	if(pState->pLastTransaction != NULL)
+	{
+		pState->pLastTransaction->Release();
+	}
+
+	pState->pLastTransaction = pTransaction;
+
+	const size_t size = pTransaction->GetData().size();
+	size_t maxPacketSize = GetMaxPacketSize(deviceAddress, endpointNumber, isDirectionIn);
+
+	if(maxPacketSize == 0)
+	{
+		if(size > pState->maxPacketSize)
+		{
+			pState->maxPacketSize = size;
+		}
+
+		const size_t defaultMaxPacketSize = GetDefaultMaxPacketSize(pTransaction->GetSpeed());
+		maxPacketSize = (pState->maxPacketSize > defaultMaxPacketSize) ? pState->maxPacketSize : defaultMaxPacketSize;
+	}
+
+	if(transfer.m_transactions.empty())
+	{
+		transfer.Begin(pTransaction);
+	}
+
+	if(size != 0)
+	{
+		transfer.AddTransaction(pTransaction, size);
+	}
+
+	transfer.m_endTicks = pTransaction->GetEndTicks();
+
+	if(size < maxPacketSize)
+	{
+		transfer.m_isZeroLengthTerminated = (size == 0);
+		EndTransfer(*pState, transferStatusCompleted);
+	}
+}
+
+void UsbDataTransferReassembler::ProcessReset(UsbReset*)
+{
+	// The device is enumerated again, its endpoints may change
+	AbortTransfers();
+	DeleteStates();
+}
+
+void UsbDataTransferReassembler::EndTransfer(endpoint_state& state, usb_transfer_status status)
+{
+	state.transfer.m_status = status;
+	ProcessDataTransfer(state.transfer);
+	state.transfer.Clear();
+}
+
+void UsbDataTransferReassembler::AbortTransfers()
+{
+	for(size_t i=0; i<stateCount; ++i)
+	{
+		if((m_pStates[i] != NULL) && !m_pStates[i]->transfer.m_transactions.empty())
+		{
+			EndTransfer(*m_pStates[i], transferStatusAborted);
+		}
+	}
+}
+
+void UsbDataTransferReassembler::DeleteStates()
+{
+	for(size_t i=0; i<stateCount; ++i)
+	{
+		if(m_pStates[i] != NULL)
+		{
+			if(m_pStates[i]->pLastTransaction != NULL)
+			{
+				m_pStates[i]->pLastTransaction->Release();
+			}
+
+			delete m_pStates[i];
+			m_pStates[i] = NULL;
+		}
+	}
+}
+
+bool UsbDataTransferReassembler::IsRetransmission(const UsbTransaction* pTransaction, const UsbTransaction* pLastTransaction)
+{
+	if((pLastTransaction == NULL) || (pTransaction->GetDataPacket().GetPID() != pLastTransaction->GetDataPacket().GetPID()))
+	{
+		return false;
+	}
+
+	// The same data toggle with another payload follows a data toggle reset
+	const vector_usbdata data = pTransaction->GetData();
+	const vector_usbdata lastData = pLastTransaction->GetData();
+
+	return (data.size() == lastData.size()) && ((data.size() == 0) || (memcmp(data.begin(), lastData.begin(), data.size()) == 0));
+}
+
+size_t UsbDataTransferReassembler::GetDefaultMaxPacketSize(usb_speed speed)
+{
+	switch(speed)
+	{
+	case speedLow:
+	case speedLowPrefixed:
+		return 8;
+
+	case speedFull:
+		return 64;
+
+	case speedHigh:
+		return 512;
+	}
+
+	return 0;
+}
+
+//---------------------------------------------------------------
+// UsbSplitTransfer
+//---------------------------------------------------------------
+
+UsbSplitTransfer::UsbSplitTransfer() :
+	m_resultTicks(0),
+	m_endTicks(0),
+	m_status(transferStatusAborted),
+	m_nyetCount(0),
+	m_startRetryCount(0)
+{
+}
+
+UsbSplitTransfer::UsbSplitTransfer(const UsbSplitTransfer& right) :
+	m_startSplits(right.m_startSplits),
+	m_completeSplits(right.m_completeSplits),
+	m_resultTicks(right.m_resultTicks),
+	m_endTicks(right.m_endTicks),
+	m_status(right.m_status),
+	m_nyetCount(right.m_nyetCount),
+	m_startRetryCount(right.m_startRetryCount)
+{
+	for(vector_split_transaction::iterator it = m_startSplits.begin(); it != m_startSplits.end(); ++it)
+	{
+		(*it)->AddRef();
+	}
+
+	for(vector_split_transaction::iterator it = m_completeSplits.begin(); it != m_completeSplits.end(); ++it)
+	{
+		(*it)->AddRef();
+	}
+}
+
+UsbSplitTransfer::~UsbSplitTransfer()
+{
+	Clear();
+}
+
+UsbSplitTransfer& UsbSplitTransfer::operator=(const UsbSplitTransfer& right)
+{
+	if(this != &right)
+	{
+		for(vector_split_transaction::const_iterator it = right.m_startSplits.begin(); it != right.m_startSplits.end(); ++it)
+		{
+			(*it)->AddRef();
+		}
+
+		for(vector_split_transaction::const_iterator it = right.m_completeSplits.begin(); it != right.m_completeSplits.end(); ++it)
+		{
+			(*it)->AddRef();
+		}
+
+		Clear();
+
+		m_startSplits = right.m_startSplits;
+		m_completeSplits = right.m_completeSplits;
+		m_resultTicks = right.m_resultTicks;
+		m_endTicks = right.m_endTicks;
+		m_status = right.m_status;
+		m_nyetCount = right.m_nyetCount;
+		m_startRetryCount = right.m_startRetryCount;
+	}
+
+	return *this;
+}
+
+usb_device_address UsbSplitTransfer::GetHubAddress() const
+{
+	return m_startSplits.empty() ? unknown_device_address : m_startSplits.front()->GetSplitHubAddress();
+}
+
+usb_hubport_number UsbSplitTransfer::GetHubPort() const
+{
+	return m_startSplits.empty() ? unknown_hubport_number : m_startSplits.front()->GetSplitHubPort();
+}
+
+usb_device_address UsbSplitTransfer::GetDeviceAddress() const
+{
+	return m_startSplits.empty() ? unknown_device_address : m_startSplits.front()->GetTokenDeviceAddress();
+}
+
+usb_endpoint_number UsbSplitTransfer::GetEndpointNumber() const
+{
+	return m_startSplits.empty() ? unknown_endpoint_number : m_startSplits.front()->GetTokenEndpointNumber();
+}
+
+usb_split_endpoint_type UsbSplitTransfer::GetEndpointType() const
+{
+	return m_startSplits.empty() ? splitEndpointTypeUnknown : m_startSplits.front()->GetSplitEndpointType();
+}
+
+usb_split_speed UsbSplitTransfer::GetSplitSpeed() const
+{
+	return m_startSplits.empty() ? splitSpeedUnknown : m_startSplits.front()->GetSplitSpeed();
+}
+
+usb_pid UsbSplitTransfer::GetTokenPid() const
+{
+	return m_startSplits.empty() ? (usb_pid) pidUnknown : m_startSplits.front()->GetTokenPacket().GetPID();
+}
+
+bool UsbSplitTransfer::IsDirectionIn() const
+{
+	return (GetTokenPid() == pidIN);
+}
+
+size_t UsbSplitTransfer::GetStartSplitCount() const
+{
+	return m_startSplits.size();
+}
+
+const UsbSplitTransaction* UsbSplitTransfer::GetStartSplit(size_t index) const
+{
+	return m_startSplits[index];
+}
+
+size_t UsbSplitTransfer::GetCompleteSplitCount() const
+{
+	return m_completeSplits.size();
+}
+
+const UsbSplitTransaction* UsbSplitTransfer::GetCompleteSplit(size_t index) const
+{
+	return m_completeSplits[index];
+}
+
+usb_pid UsbSplitTransfer::GetResultPid() const
+{
+	if(m_completeSplits.empty())
+	{
+		return pidUnknown;
+	}
+
+	const UsbSplitTransaction* pLastSplit = m_completeSplits.back();
+
+	if(!pLastSplit->GetHandshakePacket().IsEmpty())
+	{
+		return pLastSplit->GetHandshakePacket().GetPID();
+	}
+
+	return pLastSplit->GetDataPacket().GetPID();
+}
+
+usb_ticks UsbSplitTransfer::GetBeginTicks() const
+{
+	return m_startSplits.empty() ? 0 : m_startSplits.front()->GetSplitPacket().GetTicks();
+}
+
+usb_ticks UsbSplitTransfer::GetEndTicks() const
+{
+	return m_endTicks;
+}
+
+usb_ticks UsbSplitTransfer::GetTtLatency() const
+{
+	if(m_completeSplits.empty() || m_startSplits.empty())
+	{
+		return 0;
+	}
+
+	return m_resultTicks - m_startSplits.back()->GetEndTicks();
+}
+
+usb_transfer_status UsbSplitTransfer::GetStatus() const
+{
+	return m_status;
+}
+
+size_t UsbSplitTransfer::GetNyetCount() const
+{
+	return m_nyetCount;
+}
+
+size_t UsbSplitTransfer::GetStartRetryCount() const
+{
+	return m_startRetryCount;
+}
+
+void UsbSplitTransfer::Clear()
+{
+	for(vector_split_transaction::iterator it = m_startSplits.begin(); it != m_startSplits.end(); ++it)
+	{
+		(*it)->Release();
+	}
+
+	for(vector_split_transaction::iterator it = m_completeSplits.begin(); it != m_completeSplits.end(); ++it)
+	{
+		(*it)->Release();
+	}
+
+	// The capacity is kept from a transfer to the next one
+	m_startSplits.clear();
+	m_completeSplits.clear();
+	m_resultTicks = 0;
+	m_endTicks = 0;
+	m_status = transferStatusAborted;
+	m_nyetCount = 0;
+	m_startRetryCount = 0;
+}
+
+void UsbSplitTransfer::AddStartSplit(UsbSplitTransaction* pSplitTransaction)
+{
+	pSplitTransaction->AddRef();
+	m_startSplits.push_back(pSplitTransaction);
+	m_endTicks = pSplitTransaction->GetEndTicks();
+}
+
+void UsbSplitTransfer::AddCompleteSplit(UsbSplitTransaction* pSplitTransaction)
+{
+	if(m_completeSplits.empty())
+	{
+		m_resultTicks = pSplitTransaction->GetSplitPacket().GetTicks();
+	}
+
+	pSplitTransaction->AddRef();
+	m_completeSplits.push_back(pSplitTransaction);
+	m_endTicks = pSplitTransaction->GetEndTicks();
+}
+
+//---------------------------------------------------------------
+// UsbSplitTransferMatcher
+//---------------------------------------------------------------
+
+UsbSplitTransferMatcher::UsbSplitTransferMatcher() :
+	m_pStates(NULL),
+	m_capacity(defaultCapacity),
+	m_requestedCapacity(defaultCapacity),
+	m_count(0),
+	m_timeout(defaultTimeout),
+	m_lastSweepTicks(0),
+	m_unmatchedCount(0),
+	m_evictedCount(0)
+{
+	m_pStates = new split_state[m_capacity];
+	ClearStates();
+}
+
+UsbSplitTransferMatcher::~UsbSplitTransferMatcher()
+{
+	delete[] m_pStates;
+}
+
+void UsbSplitTransferMatcher::SetCapacity(size_t capacity)
+{
+	// The table always keeps a free slot
+	size_t roundedCapacity = 2;
+
+	while(roundedCapacity < capacity)
+	{
+		roundedCapacity <<= 1;
+	}
+
+	m_requestedCapacity = roundedCapacity;
+}
+
+size_t UsbSplitTransferMatcher::GetCapacity() const
+{
+	return m_capacity;
+}
+
+void UsbSplitTransferMatcher::SetTimeout(usb_ticks timeout)
+{
+	m_timeout = timeout;
+}
+
+usb_ticks UsbSplitTransferMatcher::GetTimeout() const
+{
+	return m_timeout;
+}
+
+size_t UsbSplitTransferMatcher::GetUnmatchedCount() const
+{
+	return m_unmatchedCount;
+}
+
+size_t UsbSplitTransferMatcher::GetEvictedCount() const
+{
+	return m_evictedCount;
+}
+
+void UsbSplitTransferMatcher::InitializeElementSink()
+{
+	delete[] m_pStates;
+	m_pStates = NULL;
+
+	// The table is used with its capacity, which only changes with the table
+	m_pStates = new split_state[m_requestedCapacity];
+	m_capacity = m_requestedCapacity;
+	ClearStates();
+
+	m_lastSweepTicks = 0;
+	m_unmatchedCount = 0;
+	m_evictedCount = 0;
+}
+
+void UsbSplitTransferMatcher::FinalizeElementSink()
+{
+	AbortTransfers();
+	ClearStates();
+}
+
+void UsbSplitTransferMatcher::ProcessSplitTransaction(UsbSplitTransaction* pSplitTransaction)
+{
+	if((pSplitTransaction->GetSplitHubAddress() > max_device_address) ||
+		(pSplitTransaction->GetTokenDeviceAddress() > max_device_address) ||
+		(pSplitTransaction->GetTokenEndpointNumber() > max_endpoint_number))
+	{
+		return;
+	}
+
+	const usb_ticks ticks = pSplitTransaction->GetSplitPacket().GetTicks();
+
+	// The table is swept at most once per timeout, the swept states are found again in constant time
+	if(ticks - m_lastSweepTicks >= m_timeout)
+	{
+		RemoveExpiredStates(ticks);
+		m_lastSweepTicks = ticks;
+	}
+
+	const DWORD key = GetKey(pSplitTransaction);
+
+	if(pSplitTransaction->GetSplitType() == splitTypeStart)
+	{
+		ProcessStartSplit(*FindState(key, ticks, true), pSplitTransaction);
+		return;
+	}
+
+	split_state* pState = FindState(key, ticks, false);
+
+	if((pState == NULL) || !pState->isPending || (pState->transfer.GetTokenPid() != pSplitTransaction->GetTokenPacket().GetPID()))
+	{
+		++m_unmatchedCount;
+		return;
+	}
+
+	ProcessCompleteSplit(*pState, pSplitTransaction);
+}
+
+void UsbSplitTransferMatcher::ProcessReset(UsbReset*)
+{
+	AbortTransfers();
+	ClearStates();
+}
+
+void UsbSplitTransferMatcher::ProcessStartSplit(split_state& state, UsbSplitTransaction* pSplitTransaction)
+{
+	const usb_split_endpoint_type endpointType = pSplitTransaction->GetSplitEndpointType();
+	const bool isPeriodic = (endpointType == splitEndpointTypeIsochronous) || (endpointType == splitEndpointTypeInterrupt);
+	const bool isIsochronousOut = (endpointType == splitEndpointTypeIsochronous) && !pSplitTransaction->IsDirectionIn();
+
+	state.lastTicks = pSplitTransaction->GetSplitPacket().GetTicks();
+
+	// The periodic start splits have no handshake, the others are accepted by an ACK
+	if(!isPeriodic && (pSplitTransaction->GetHandshakePacket().GetPID() != pidACK))
+	{
+		if(pSplitTransaction->GetHandshakePacket().GetPID() == pidNAK)
+		{
+			++state.startRetryCount;
+		}
+
+		return;
+	}
+
+	usb_split_isoc_out_payload_continuation continuation = splitIsocOutPayloadContinuationNotApplicable;
+
+	if(isIsochronousOut)
+	{
+		continuation = pSplitTransaction->GetIsocOutPayloadContinuation();
+	}
+
+	if(state.isPending)
+	{
+		const bool isContinued = isIsochronousOut &&
+			(state.transfer.GetEndpointType() == splitEndpointTypeIsochronous) && !state.transfer.IsDirectionIn() &&
+			((continuation == splitIsocOutPayloadContinuationMiddle) || (continuation == splitIsocOutPayloadContinuationEnd));
+
+		if(!isContinued || (state.transfer.m_startSplits.size() >= maxSplitCount))
+		{
+			EndTransfer(state, transferStatusAborted);
+		}
+	}
+
+	if(!state.isPending)
+	{
+		state.isPending = true;
+		state.transfer.m_startRetryCount = state.startRetryCount;
+		state.startRetryCount = 0;
+	}
+
+	state.transfer.AddStartSplit(pSplitTransaction);
+
+	// The isochronous OUT transactions have no complete split
+	if((continuation == splitIsocOutPayloadContinuationAll) || (continuation == splitIsocOutPayloadContinuationEnd))
+	{
+		EndTransfer(state, transferStatusCompleted);
+	}
+}
+
+void UsbSplitTransferMatcher::ProcessCompleteSplit(split_state& state, UsbSplitTransaction* pSplitTransaction)
+{
+	UsbSplitTransfer& transfer = state.transfer;
+	const UsbPacketHandshake& handshake = pSplitTransaction->GetHandshakePacket();
+	const UsbPacketData& data = pSplitTransaction->GetDataPacket();
+
+	state.lastTicks = pSplitTransaction->GetSplitPacket().GetTicks();
+
+	if(handshake.IsEmpty() && data.IsEmpty())
+	{
+		// No answer from the hub, the host retries the complete split
+		return;
+	}
+
+	if(handshake.GetPID() == pidNYET)
+	{
+		++transfer.m_nyetCount;
+		transfer.m_endTicks = pSplitTransaction->GetEndTicks();
+		return;
+	}
+
+	if(transfer.m_completeSplits.size() >= maxSplitCount)
+	{
+		EndTransfer(state, transferStatusAborted);
+		return;
+	}
+
+	transfer.AddCompleteSplit(pSplitTransaction);
+
+	// The periodic IN payloads larger than a microframe continue with MDATA
+	if(handshake.IsEmpty() && (data.GetPID() == pidMDATA))
+	{
+		return;
+	}
+
+	EndTransfer(state, (handshake.GetPID() == pidSTALL) ? transferStatusStalled : transferStatusCompleted);
+}
+
+UsbSplitTransferMatcher::split_state* UsbSplitTransferMatcher::FindState(DWORD key, usb_ticks ticks, bool isCreated)
+{
+	const size_t mask = m_capacity - 1;
+	size_t index = GetHomeIndex(key);
+
+	// Linear probing, the table always keeps a free slot
+	while(m_pStates[index].isUsed)
+	{
+		split_state& state = m_pStates[index];
+
+		if(state.key == key)
+		{
+			if(state.isPending && (ticks - state.lastTicks > m_timeout))
+			{
+				EndTransfer(state, transferStatusTimedOut);
+			}
+
+			return &state;
+		}
+
+		index = (index + 1) & mask;
+	}
+
+	if(!isCreated)
+	{
+		return NULL;
+	}
+
+	if(m_count + 1 >= m_capacity)
+	{
+		RemoveExpiredStates(ticks);
+
+		if(m_count + 1 >= m_capacity)
+		{
+			RemoveOldestState();
+		}
+
+		// The removals moved the states, the free slot is searched again
+		index = GetHomeIndex(key);
+
+		while(m_pStates[index].isUsed)
+		{
+			index = (index + 1) & mask;
+		}
+	}
+
+	split_state& state = m_pStates[index];
+	state.isUsed = true;
+	state.isPending = false;
+	state.key = key;
+	state.lastTicks = ticks;
+	state.startRetryCount = 0;
+	++m_count;
+
+	return &state;
+}
+
+void UsbSplitTransferMatcher::RemoveState(size_t index)
+{
+	const size_t mask = m_capacity - 1;
+	size_t hole = index;
+
+	m_pStates[hole].isUsed = false;
+	m_pStates[hole].transfer.Clear();
+	--m_count;
+
+	// Backward shift deletion: the following states of the cluster are moved
+	// into the hole when their home index is not between the hole and them
+	for(size_t next = (hole + 1) & mask; m_pStates[next].isUsed; next = (next + 1) & mask)
+	{
+		const size_t home = GetHomeIndex(m_pStates[next].key);
+
+		if(((next - home) & mask) >= ((next - hole) & mask))
+		{
+			split_state& target = m_pStates[hole];
+			split_state& source = m_pStates[next];
+
+			target.isUsed = true;
+			target.isPending = source.isPending;
+			target.key = source.key;
+			target.lastTicks = source.lastTicks;
+			target.startRetryCount = source.startRetryCount;
+			target.transfer = source.transfer;
+
+			source.isUsed = false;
+			source.transfer.Clear();
+			hole = next;
+		}
+	}
+}
+
+void UsbSplitTransferMatcher::RemoveExpiredStates(usb_ticks ticks)
+{
+	size_t i = 0;
+
+	while(i < m_capacity)
+	{
+		split_state& state = m_pStates[i];
+
+		if(!state.isUsed || (ticks - state.lastTicks <= m_timeout))
+		{
+			++i;
+			continue;
+		}
+
+		if(state.isPending)
+		{
+			EndTransfer(state, transferStatusTimedOut);
+		}
+
+		// Another state may be moved at the same index
+		RemoveState(i);
+	}
+}
+
+void UsbSplitTransferMatcher::RemoveOldestState()
+{
+	size_t oldestIndex = m_capacity;
+
+	for(size_t i=0; i<m_capacity; ++i)
+	{
+		if(m_pStates[i].isUsed && ((oldestIndex == m_capacity) || (m_pStates[i].lastTicks < m_pStates[oldestIndex].lastTicks)))
+		{
+			oldestIndex = i;
+		}
+	}
+
+	if(oldestIndex == m_capacity)
+	{
+		return;
+	}
+
+	if(m_pStates[oldestIndex].isPending)
+	{
+		EndTransfer(m_pStates[oldestIndex], transferStatusAborted);
+	}
+
+	RemoveState(oldestIndex);
+	++m_evictedCount;
+}
+
+void UsbSplitTransferMatcher::EndTransfer(split_state& state, usb_transfer_status status)
+{
+	state.isPending = false;
+	state.transfer.m_status = status;
+
+	ProcessSplitTransfer(state.transfer);
+	state.transfer.Clear();
+}
+
+void UsbSplitTransferMatcher::AbortTransfers()
+{
+	for(size_t i=0; i<m_capacity; ++i)
+	{
+		if(m_pStates[i].isUsed && m_pStates[i].isPending)
+		{
+			EndTransfer(m_pStates[i], transferStatusAborted);
+		}
+	}
+}
+
+void UsbSplitTransferMatcher::ClearStates()
+{
+	for(size_t i=0; i<m_capacity; ++i)
+	{
+		m_pStates[i].isUsed = false;
+		m_pStates[i].isPending = false;
+		m_pStates[i].transfer.Clear();
+	}
+
+	m_count = 0;
+}
+
+size_t UsbSplitTransferMatcher::GetHomeIndex(DWORD key) const
+{
+	// Fibonacci hashing spreads the consecutive keys over the table
+	DWORD hash = (DWORD) ((key * 2654435761UL) & 0xFFFFFFFF);
+	hash ^= hash >> 16;
+
+	return hash & (m_capacity - 1);
+}
+
+DWORD UsbSplitTransferMatcher::GetKey(const UsbSplitTransaction* pSplitTransaction)
+{
+	// The control endpoints are bidirectional, their stages do not overlap
+	const bool isDirectionIn = (pSplitTransaction->GetSplitEndpointType() != splitEndpointTypeControl) && pSplitTransaction->IsDirectionIn();
+
+	return ((DWORD) pSplitTransaction->GetSplitHubAddress() << 19) |
+		((DWORD) (pSplitTransaction->GetSplitHubPort() & max_hubport_number) << 12) |
+		((DWORD) pSplitTransaction->GetTokenDeviceAddress() << 5) |
+		((DWORD) pSplitTransaction->GetTokenEndpointNumber() << 1) |
+		(isDirectionIn ? 1 : 0);
+}
+
+}
@@ -89,6 +89,46 @@ typedef double usb_time;
 ///	Specifies an unknown USB time.
 const usb_time unknown_time = 1.7976931348623158e+308;  /* double max value */
 
+/// @brief
+///		USB time in ticks.
+/// @remarks
+///		A tick is one picosecond. Unlike usb_time, the resolution does not 
+///		depend on the length of the capture, and the comparisons and the 
+///		differences are exact integer operations. The range is about 106 days.
+/// @seealso
+///		usb_time, UsbTimeToTicks, UsbTicksToTime
+typedef signed __int64 usb_ticks;
+
+///	Count of ticks in one second.
+const usb_ticks usb_ticks_per_second = (usb_ticks) 1000000 * 1000000;
+
+///	Specifies an unknown USB time in ticks.
+const usb_ticks unknown_ticks = (usb_ticks) (((DWORDLONG) -1) >> 1);  /* __int64 max value */
+
+/// Helper function to convert a USB time to ticks.
+inline usb_ticks UsbTimeToTicks(usb_time time)
+{
+	if(time == unknown_time)
+	{
+		return unknown_ticks;
+	}
+
+	// Round to the nearest tick
+	double ticks = time * usb_ticks_per_second;
+	return (usb_ticks) ((ticks >= 0) ? (ticks + 0.5) : (ticks - 0.5));
+}
+
+/// Helper function to convert ticks to a USB time.
+inline usb_time UsbTicksToTime(usb_ticks ticks)
+{
+	if(ticks == unknown_ticks)
+	{
+		return unknown_time;
+	}
+
+	return (usb_time) ticks / usb_ticks_per_second;
+}
+
 /// @brief
 ///		USB CRC-5 type.
 /// @remarks
@@ -279,4 +319,20 @@ inline bool UsbEndpointIsDirectionIn(usb_endpoint_address a)
 /// USB data type.
 typedef ref_vector<BYTE> vector_usbdata;
 
+/// @brief
+///		Reference counting policy of the USB elements and of their raw data.
+/// @remarks
+///		The elements are shared between the acquisition thread and the analysis
+///		threads by default. Define USBDK_ELEMENT_REFCOUNT_POLICY to
+///		RefCountPolicySingleThread before including UsbAnalysis.h to use
+///		non-atomic reference counts in single-threaded applications.
+/// @seealso
+///		RefCountPolicyMultiThread, RefCountPolicySingleThread, UsbElement
+#ifndef USBDK_ELEMENT_REFCOUNT_POLICY
+	#define USBDK_ELEMENT_REFCOUNT_POLICY RefCountPolicyMultiThread
+#endif
+
+///	Reference counting policy type of the USB elements.
+typedef USBDK_ELEMENT_REFCOUNT_POLICY usb_element_refcount_policy;
+
 } // End of the usbdk namespace
@@ -10,6 +10,8 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <cstddef>
+#include <cstring>
+#include <algorithm>
 #include <stdexcept>
 #include <xmemory>
 
@@ -156,8 +158,8 @@ public:
 	}
 
 private:
-	// check range (may be private because it is static)
-	static void rangecheck (size_type i) 
+	// check range
+	void rangecheck (size_type i) const
 	{
 		if(i >= size()) 
 		{ 
@@ -177,7 +179,7 @@ private:
 
 	void copy(const T* buffer)
 	{
-		memcpy(ptr(), buffer, m_size);
+		memcpy(ptr(), buffer, m_size*sizeof(T));
 	}
 
 	void tidy()
@@ -244,7 +246,7 @@ private:
 template<class T>
 bool operator== (const small_vector<T>& x, const small_vector<T>& y) 
 {
-	return std::equal(x.begin(), x.end(), y.begin());
+	return (x.size() == y.size()) && std::equal(x.begin(), x.end(), y.begin());
 }
 template<class T>
 bool operator< (const small_vector<T>& x, const small_vector<T>& y) 
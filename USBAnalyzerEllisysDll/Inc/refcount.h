@@ -13,27 +13,87 @@
 
 #pragma once
 
+// The interlocked intrinsics are declared here, so this header does not
+// depend on windows.h being included before it
+extern "C" long __cdecl _InterlockedIncrement(long volatile* pAddend);
+extern "C" long __cdecl _InterlockedDecrement(long volatile* pAddend);
+#pragma intrinsic(_InterlockedIncrement)
+#pragma intrinsic(_InterlockedDecrement)
+
 namespace usbdk {
 
-/// Base class for reference counting.
-class RefCount
+/// @brief
+///		Reference counting policy for objects used by a single thread.
+/// @remarks
+///		The reference count is updated without synchronization.
+///		This is the fastest policy, but the objects must not be 
+///		referenced or released by several threads.
+/// @seealso
+///		RefCountPolicyMultiThread, RefCountT
+struct RefCountPolicySingleThread
+{
+	/// Increments a reference count and returns the new value.
+	static long Increment(volatile long* pRefCount)
+	{
+		return ++(*pRefCount);
+	}
+
+	/// Decrements a reference count and returns the new value.
+	static long Decrement(volatile long* pRefCount)
+	{
+		return --(*pRefCount);
+	}
+};
+
+/// @brief
+///		Reference counting policy for objects shared between threads.
+/// @remarks
+///		The reference count is updated with interlocked operations. They
+///		are full memory barriers, so the writes made to the object before 
+///		the last Release are visible to the thread deleting the object.
+/// @seealso
+///		RefCountPolicySingleThread, RefCountT
+struct RefCountPolicyMultiThread
+{
+	/// Increments a reference count and returns the new value.
+	static long Increment(volatile long* pRefCount)
+	{
+		return _InterlockedIncrement(pRefCount);
+	}
+
+	/// Decrements a reference count and returns the new value.
+	static long Decrement(volatile long* pRefCount)
+	{
+		return _InterlockedDecrement(pRefCount);
+	}
+};
+
+/// @brief
+///		Base class for reference counting with a selectable policy.
+/// @remarks
+///		TPolicy is RefCountPolicySingleThread or RefCountPolicyMultiThread.
+/// @seealso
+///		RefCount, RefCountPtr
+template<class TPolicy>
+class RefCountT
 {
 private:
-	long m_refCount;
+	volatile long m_refCount;
 
 public:
 	/// @brief 
-	///		Constructs a RefCount object.
-	RefCount() :
+	///		Constructs a RefCountT object.
+	RefCountT() :
 		m_refCount(0)
 	{
 	}
 
 	/// @brief 
-	///		Constructs a RefCount object from a copy.
+	///		Constructs a RefCountT object from a copy.
 	/// @param
-	///		copy - An existing RefCount object to be copied into this object.
-	RefCount(const RefCount& copy)
+	///		copy - An existing RefCountT object to be copied into this object.
+	RefCountT(const RefCountT& copy) :
+		m_refCount(0)
 	{
 		// Don't copy refCount
 	}
@@ -41,16 +101,16 @@ public:
 	/// @brief 
 	///		Assignment operator.
 	/// @param
-	///		copy - An existing RefCount object to be copied into this object.
-	RefCount& operator=(const RefCount& copy)
+	///		copy - An existing RefCountT object to be copied into this object.
+	RefCountT& operator=(const RefCountT& copy)
 	{
 		// Don't copy refCount
 		return *this;
 	}
 
 	/// @brief 
-	///		Destructs a RefCount object.
-	virtual ~RefCount()
+	///		Destructs a RefCountT object.
+	virtual ~RefCountT()
 	{
 	}
 
@@ -67,7 +127,7 @@ public:
 	///		RefCountPtr
 	long AddRef()  
 	{
-		return ++m_refCount; 
+		return TPolicy::Increment(&m_refCount); 
 	}
 
 	/// @brief 
@@ -75,6 +135,10 @@ public:
 	/// @remarks 
 	///		It is usually better to use RefCountPtr to automatically 
 	///		manage reference counting instead of doing it manually.
+	///
+	///		Releasing an object without reference is an error. It asserts
+	///		in debug builds, and in every build the object is left alone
+	///		and 0 is returned, like the Release compiled in the library.
 	/// @return
 	///		This function returns the new decremented reference count 
 	///		on the object. In debug builds, the return value may be 
@@ -83,12 +147,14 @@ public:
 	///		RefCountPtr
 	long Release() 
 	{
+		ASSERT(m_refCount != 0);
+
 		if(m_refCount == 0) 
 		{
 			return 0;
 		}
 
-		long refCount = --m_refCount;
+		long refCount = TPolicy::Decrement(&m_refCount);
 
 		if(refCount == 0) 
 		{
@@ -99,6 +165,12 @@ public:
 	}
 };
 
+/// Base class for reference counting of objects used by a single thread.
+typedef RefCountT<RefCountPolicySingleThread> RefCount;
+
+/// Base class for reference counting of objects shared between threads.
+typedef RefCountT<RefCountPolicyMultiThread> RefCountMultiThread;
+
 /// @brief 
 ///		Creates an instance of a reference counted object.
 /// @return
@@ -153,6 +225,20 @@ public:
 		AddRef();
 	}
 
+#ifdef ELLISYS_HAS_RVALUE_REFERENCES
+	/// @brief 
+	///		Constructs a new RefCountPtr object by moving an existing one.
+	/// @remarks
+	///		The reference is transferred, the reference count is not modified.
+	/// @param 
+	///		other - An existing RefCountPtr object, empty after the call.
+	RefCountPtr(RefCountPtr<T>&& other) throw() : 
+		m_p(other.m_p)
+	{
+		other.m_p = NULL;
+	}
+#endif
+
 	/// @brief 
 	///		Destructs a RefCountPtr object.
 	~RefCountPtr() throw()
@@ -217,6 +303,23 @@ public:
 		return m_p;
 	}
 
+#ifdef ELLISYS_HAS_RVALUE_REFERENCES
+	/// @brief 
+	///		Move assignment operator.
+	/// @remarks
+	///		The reference is transferred, the reference count is not modified.
+	RefCountPtr<T>& operator=(RefCountPtr<T>&& other) throw()
+	{
+		if(this != &other)
+		{
+			Release();
+			m_p = other.m_p;
+			other.m_p = NULL;
+		}
+		return (*this);
+	}
+#endif
+
 	/// Assignment operator.
 	template<class Other>
 	RefCountPtr<T>& operator=(RefCountPtr<Other>& copy) throw()
@@ -259,6 +362,20 @@ public:
 		m_p = p;
 	}
 
+	/// @brief 
+	///		Exchanges the pointers of two RefCountPtr objects.
+	/// @remarks
+	///		The reference counts are not modified. Use this method to 
+	///		transfer a reference without a move constructor.
+	/// @param 
+	///		other - The RefCountPtr object to exchange with.
+	void Swap(RefCountPtr<T>& other) throw()
+	{
+		T* p = m_p;
+		m_p = other.m_p;
+		other.m_p = p;
+	}
+
 	/// @brief 
 	///		Releases ownership of the pointer.
 	/// @return